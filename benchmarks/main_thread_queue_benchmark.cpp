@@ -0,0 +1,172 @@
+/*
+ * This file is part of the Loki Project.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+#include "CLI/CLI.hpp"
+#include "engine/mt/main_thread_queue.h"
+#include "spdlog/spdlog.h"
+
+namespace {
+
+  using Clock = std::chrono::steady_clock;
+
+  // The queue as it was before: a mutex and std::function, locked once to check for tasks and once to take one
+  class MutexQueue
+  {
+  public:
+    void add_task(std::function<void()>&& task)
+    {
+      std::lock_guard lock(mutex);
+      tasks.emplace(std::move(task));
+    }
+
+    void perform_all_tasks()
+    {
+      while (!is_empty()) {
+        if (auto task = get_next_task()) {
+          task();
+        }
+      }
+    }
+
+  private:
+    auto is_empty() -> bool
+    {
+      std::lock_guard lock(mutex);
+      return tasks.empty();
+    }
+
+    auto get_next_task() -> std::function<void()>
+    {
+      std::lock_guard lock(mutex);
+      if (tasks.empty()) {
+        return {};
+      }
+
+      auto task = std::move(tasks.front());
+      tasks.pop();
+      return task;
+    }
+
+  private:
+    std::mutex mutex;
+    std::queue<std::function<void()>> tasks;
+  };
+
+  // About what a file completion carries: a couple of pointers and a size, too big for the std::function small buffer
+  struct Payload
+  {
+    std::array<std::uint64_t, 4> data{};
+  };
+
+  // Producers stand in for the file and network threads, the calling thread drains like the main thread does every frame
+  template<typename AddTask, typename Drain>
+  auto run(std::size_t num_producers, std::size_t num_tasks, AddTask&& add_task, Drain&& drain) -> double
+  {
+    std::atomic_size_t num_performed{ 0 };
+    std::atomic_bool go{ false };
+    std::vector<std::thread> producers;
+
+    for (std::size_t p = 0; p < num_producers; ++p) {
+      producers.emplace_back([&, p]() {
+        while (!go.load(std::memory_order_acquire)) {
+        }
+
+        for (std::size_t i = 0; i < num_tasks; ++i) {
+          Payload payload;
+          payload.data[0] = p;
+          payload.data[1] = i;
+          add_task([payload, &num_performed]() {
+            num_performed.fetch_add(1 + payload.data[3], std::memory_order_relaxed);
+          });
+        }
+      });
+    }
+
+    auto total = num_producers * num_tasks;
+    auto start = Clock::now();
+    go.store(true, std::memory_order_release);
+
+    while (num_performed.load(std::memory_order_relaxed) < total) {
+      drain();
+    }
+
+    auto seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+    for (auto& producer : producers) {
+      producer.join();
+    }
+
+    return seconds;
+  }
+
+  void report(const std::string& name, std::size_t num_producers, std::size_t num_tasks, double seconds)
+  {
+    spdlog::info("{:<24} {:>2} producers {:>9} tasks {:>8.3f} s {:>12.0f} tasks/s", name, num_producers, num_tasks, seconds,
+        seconds > 0.0 ? static_cast<double>(num_tasks) / seconds : 0.0);
+  }
+
+} // namespace
+
+int
+main(int argc, char* argv[])
+{
+  CLI::App app{ "Loki main thread queue benchmark" };
+  argv = app.ensure_utf8(argv);
+
+  std::size_t num_tasks = 1000000;
+  std::size_t max_producers = std::max(std::thread::hardware_concurrency(), 2u);
+
+  app.add_option("--tasks", num_tasks, "Tasks pushed by each producer");
+  app.add_option("--max-producers", max_producers, "Producer counts double from 1 up to this");
+  CLI11_PARSE(app, argc, argv)
+
+  for (std::size_t num_producers = 1; num_producers <= max_producers; num_producers *= 2) {
+    MutexQueue mutex_queue;
+    auto mutex_seconds = run(
+        num_producers, num_tasks,
+        [&mutex_queue](auto&& task) {
+          mutex_queue.add_task(std::move(task));
+        },
+        [&mutex_queue]() {
+          mutex_queue.perform_all_tasks();
+        });
+    report("Mutex + std::function", num_producers, num_producers * num_tasks, mutex_seconds);
+
+    auto& main_thread_queue = loki::MainThreadQueue::get_ref();
+    auto lock_free_seconds = run(
+        num_producers, num_tasks,
+        [&main_thread_queue](auto&& task) {
+          main_thread_queue.add_task(std::move(task));
+        },
+        [&main_thread_queue]() {
+          main_thread_queue.perform_all_tasks();
+        });
+    report("MainThreadQueue", num_producers, num_producers * num_tasks, lock_free_seconds);
+  }
+
+  return 0;
+}
@@ -0,0 +1,411 @@
+/*
+ * This file is part of the Loki Project.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <random>
+#include <thread>
+#include <unordered_map>
+
+#include "CLI/CLI.hpp"
+#include "engine/asset/asset.h"
+#include "engine/datasource/mpq/mpq_chain.h"
+#include "engine/datasource/mpq/mpq_file_manager.h"
+#include "engine/mt/job_system.h"
+#include "engine/mt/main_thread_queue.h"
+#include "spdlog/spdlog.h"
+
+// Generates a synthetic patch chain with StormLib and measures it through every layer of the I/O path,
+// from raw MPQChain/MPQFile reads to MPQFileManager and asset loads. Needs nothing but a writable directory
+namespace {
+
+  using Clock = std::chrono::steady_clock;
+
+  struct SyntheticFile
+  {
+    std::string path;
+    std::size_t size;
+  };
+
+  struct Compression
+  {
+    const char* name;
+    DWORD flags;
+    DWORD compression;
+  };
+
+  // The mix the game data has: mostly zlib, some bzip2 and PKWARE, a few files stored as is or in a single unit
+  const Compression compressions[] = {
+    { "zlib", MPQ_FILE_COMPRESS, MPQ_COMPRESSION_ZLIB },
+    { "zlib", MPQ_FILE_COMPRESS, MPQ_COMPRESSION_ZLIB },
+    { "zlib", MPQ_FILE_COMPRESS, MPQ_COMPRESSION_ZLIB },
+    { "bzip2", MPQ_FILE_COMPRESS, MPQ_COMPRESSION_BZIP2 },
+    { "pkware", MPQ_FILE_IMPLODE, MPQ_COMPRESSION_PKWARE },
+    { "none", 0, 0 },
+    { "single unit", MPQ_FILE_COMPRESS | MPQ_FILE_SINGLE_UNIT, MPQ_COMPRESSION_ZLIB },
+  };
+
+  auto elapsed_seconds(Clock::time_point start) -> double
+  {
+    return std::chrono::duration<double>(Clock::now() - start).count();
+  }
+
+  auto make_content(std::mt19937& random, std::size_t size) -> std::vector<char>
+  {
+    // Half text-like and compressible, half noise, roughly what models and textures compress to
+    std::vector<char> data(size);
+    std::uniform_int_distribution<int> byte(0, 255);
+    for (std::size_t i = 0; i < size; ++i) {
+      data[i] = static_cast<char>(i % 2 ? byte(random) : 'A' + i % 23);
+    }
+    return data;
+  }
+
+  auto make_size(std::mt19937& random) -> std::size_t
+  {
+    std::uniform_int_distribution<int> bucket(0, 99);
+    auto value = bucket(random);
+
+    // Small files dominate, a few big ones go through the parallel sector reader
+    if (value < 60) {
+      return std::uniform_int_distribution<std::size_t>(1024, 16 * 1024)(random);
+    }
+    if (value < 95) {
+      return std::uniform_int_distribution<std::size_t>(16 * 1024, 256 * 1024)(random);
+    }
+    return std::uniform_int_distribution<std::size_t>(512 * 1024, 4 * 1024 * 1024)(random);
+  }
+
+  auto write_archive(const std::filesystem::path& archive_path, const std::vector<SyntheticFile>& files, std::mt19937& random) -> bool
+  {
+    std::filesystem::remove(archive_path);
+
+    HANDLE archive{};
+    auto max_files = static_cast<DWORD>(std::bit_ceil(files.size() + 16));
+    if (!SFileCreateArchive(archive_path.string().c_str(), MPQ_CREATE_ARCHIVE_V2 | MPQ_CREATE_LISTFILE | MPQ_CREATE_ATTRIBUTES, max_files, &archive)) {
+      spdlog::error("Cannot create '{}'", archive_path.string());
+      return false;
+    }
+
+    std::uniform_int_distribution<std::size_t> pick(0, std::size(compressions) - 1);
+    bool result = true;
+
+    for (const auto& file : files) {
+      const auto& compression = compressions[pick(random)];
+      auto data = make_content(random, file.size);
+
+      HANDLE handle{};
+      if (!SFileCreateFile(archive, file.path.c_str(), 0, static_cast<DWORD>(data.size()), 0, compression.flags | MPQ_FILE_REPLACEEXISTING, &handle) ||
+          !SFileWriteFile(handle, data.data(), static_cast<DWORD>(data.size()), compression.compression) || !SFileFinishFile(handle)) {
+        spdlog::error("Cannot write '{}' to '{}'", file.path, archive_path.string());
+        result = false;
+        break;
+      }
+    }
+
+    SFileCloseArchive(archive);
+    return result;
+  }
+
+  void report(const std::string& name, std::size_t num_files, std::size_t num_bytes, double seconds)
+  {
+    double megabytes = static_cast<double>(num_bytes) / (1024.0 * 1024.0);
+    spdlog::info("{:<28} {:>7} files {:>9.1f} MB {:>8.3f} s {:>10.0f} files/s {:>8.1f} MB/s", name, num_files, megabytes, seconds,
+        seconds > 0.0 ? static_cast<double>(num_files) / seconds : 0.0, seconds > 0.0 ? megabytes / seconds : 0.0);
+  }
+
+  void report_latency(const std::string& name, std::vector<double> latencies)
+  {
+    if (latencies.empty()) {
+      return;
+    }
+
+    std::sort(latencies.begin(), latencies.end());
+    auto percentile = [&latencies](double p) {
+      return latencies[static_cast<std::size_t>(p * static_cast<double>(latencies.size() - 1))] * 1000.0;
+    };
+
+    spdlog::info("{:<28} p50 {:.3f} ms, p95 {:.3f} ms, p99 {:.3f} ms, max {:.3f} ms", name, percentile(0.5), percentile(0.95), percentile(0.99),
+        latencies.back() * 1000.0);
+  }
+
+  auto read_through_chain(const loki::MPQChain& chain, const std::vector<SyntheticFile>& files) -> std::size_t
+  {
+    std::size_t num_bytes = 0;
+    std::vector<char> buffer;
+
+    for (const auto& file : files) {
+      HANDLE handle{};
+      if (!SFileOpenFileEx(chain.get_archive().get_handle(), file.path.c_str(), SFILE_OPEN_FROM_MPQ, &handle)) {
+        continue;
+      }
+
+      num_bytes += loki::MPQFile(file.path, handle).read_all(buffer);
+      SFileCloseFile(handle);
+    }
+
+    return num_bytes;
+  }
+
+  // Records when each asset gets its data on the main thread
+  std::unordered_map<const void*, Clock::time_point> loaded_times;
+
+  class BenchmarkAsset : public loki::AssetWrapper<BenchmarkAsset>
+  {
+  public:
+    auto get_memory_usage() const -> MemoryUsage override
+    {
+      return {};
+    }
+
+  protected:
+    auto prepare(std::span<const char>) -> bool override
+    {
+      return true;
+    }
+
+    void upload() override
+    {
+      loaded_times[this] = Clock::now();
+    }
+
+    void release() override
+    {
+    }
+  };
+
+} // namespace
+
+int
+main(int argc, char* argv[])
+{
+  CLI::App app{ "Loki MPQ benchmark on synthetic archives" };
+  argv = app.ensure_utf8(argv);
+
+  std::filesystem::path work_dir = std::filesystem::temp_directory_path() / "loki-mpq-benchmark";
+  std::size_t num_files = 2000;
+  std::size_t num_patched = 400;
+  std::size_t num_random_reads = 20000;
+  std::size_t iterations = 5;
+  unsigned seed = 1;
+
+  app.add_option("--dir", work_dir, "Directory to generate the archives in");
+  app.add_option("--files", num_files, "Files in the base archive");
+  app.add_option("--patched", num_patched, "Files replaced by each of the two patch archives");
+  app.add_option("--random-reads", num_random_reads, "Ranged reads at random offsets");
+  app.add_option("--iterations", iterations, "Repetitions of the open latency measurement");
+  app.add_option("--seed", seed, "Seed of the generated content");
+  CLI11_PARSE(app, argc, argv)
+
+  std::mt19937 random(seed);
+  auto data_dir = work_dir / "Data";
+  std::filesystem::create_directories(data_dir);
+
+  std::vector<SyntheticFile> files;
+  for (std::size_t i = 0; i < num_files; ++i) {
+    files.push_back({ fmt::format("World\\Benchmark\\{:03}\\File{:05}.bin", i % 97, i), make_size(random) });
+  }
+
+  // Two patch layers over the base, both replace files of the one below
+  auto pick_patched = [&](std::size_t count) {
+    std::vector<SyntheticFile> patched;
+    std::sample(files.begin(), files.end(), std::back_inserter(patched), std::min(count, files.size()), random);
+    for (auto& file : patched) {
+      file.size = make_size(random);
+    }
+    return patched;
+  };
+
+  auto generation_start = Clock::now();
+  if (!write_archive(data_dir / "common.MPQ", files, random) || !write_archive(data_dir / "patch.MPQ", pick_patched(num_patched), random) ||
+      !write_archive(data_dir / "patch-2.MPQ", pick_patched(num_patched), random)) {
+    return 1;
+  }
+
+  // Sizes changed with the patches, the sizes the benchmark needs are the ones of the chain
+  std::filesystem::remove(data_dir.string() + ".index");
+  spdlog::info("Generated {} files in 3 archives in {:.2f} s", files.size(), elapsed_seconds(generation_start));
+
+  auto archive_paths = loki::MPQChain::find_archives(data_dir);
+
+  // Open latency of the whole chain, base plus patches
+  {
+    std::vector<double> latencies;
+    for (std::size_t i = 0; i < iterations; ++i) {
+      auto start = Clock::now();
+      loki::MPQChain chain(archive_paths);
+      latencies.push_back(elapsed_seconds(start));
+      chain.close();
+    }
+
+    report_latency("Chain open", latencies);
+  }
+
+  loki::MPQChain chain(archive_paths);
+
+  // Open latency of single files, resolved through the patch layers
+  {
+    std::vector<double> latencies;
+    for (const auto& file : files) {
+      HANDLE handle{};
+      auto start = Clock::now();
+      if (SFileOpenFileEx(chain.get_archive().get_handle(), file.path.c_str(), SFILE_OPEN_FROM_MPQ, &handle)) {
+        latencies.push_back(elapsed_seconds(start));
+        SFileCloseFile(handle);
+      }
+    }
+
+    report_latency("File open", latencies);
+  }
+
+  {
+    auto start = Clock::now();
+    auto num_bytes = read_through_chain(chain, files);
+    report("Chain, sequential", files.size(), num_bytes, elapsed_seconds(start));
+  }
+
+  {
+    auto shuffled = files;
+    std::shuffle(shuffled.begin(), shuffled.end(), random);
+
+    auto start = Clock::now();
+    auto num_bytes = read_through_chain(chain, shuffled);
+    report("Chain, random order", shuffled.size(), num_bytes, elapsed_seconds(start));
+  }
+
+  // Small ranged reads, only the sectors covering the range are decompressed
+  {
+    std::uniform_int_distribution<std::size_t> pick(0, files.size() - 1);
+    std::size_t num_bytes = 0;
+    auto start = Clock::now();
+
+    for (std::size_t i = 0; i < num_random_reads; ++i) {
+      const auto& file = files[pick(random)];
+      HANDLE handle{};
+      if (!SFileOpenFileEx(chain.get_archive().get_handle(), file.path.c_str(), SFILE_OPEN_FROM_MPQ, &handle)) {
+        continue;
+      }
+
+      loki::MPQFile mpq_file(file.path, handle);
+      auto offset = std::uniform_int_distribution<unsigned long>(0, mpq_file.get_size())(random);
+      num_bytes += mpq_file.read_range(offset, 4096).size();
+      SFileCloseFile(handle);
+    }
+
+    report("Chain, random 4K ranges", num_random_reads, num_bytes, elapsed_seconds(start));
+  }
+
+  chain.close();
+
+  // Everything below goes through the file manager with its caches off, every request is a real read
+  loki::JobSystem::get_ref().init(loki::JobSystem::get_default_num_workers());
+
+  auto& file_manager = loki::MPQFileManager::get_ref();
+  file_manager.get_cache().set_budget(0);
+  file_manager.get_cache().set_compressed_budget(0);
+  file_manager.init(data_dir);
+
+  while (!file_manager.get_index()) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+
+  {
+    std::atomic_size_t remaining = files.size();
+    std::atomic_size_t num_bytes = 0;
+    auto start = Clock::now();
+
+    for (const auto& file : files) {
+      file_manager.request_file(file.path, [&](const loki::FileBuffer& buffer) {
+        num_bytes += buffer.size();
+        --remaining;
+      });
+    }
+
+    while (remaining) {
+      std::this_thread::yield();
+    }
+
+    report(fmt::format("File manager, {} workers", file_manager.get_num_workers()), files.size(), num_bytes, elapsed_seconds(start));
+  }
+
+  {
+    std::vector<std::filesystem::path> paths;
+    for (const auto& file : files) {
+      paths.emplace_back(file.path);
+    }
+
+    std::atomic_bool done = false;
+    std::size_t num_bytes = 0;
+    auto start = Clock::now();
+
+    file_manager.request_files(paths, [&](std::vector<loki::FileBuffer>&& buffers) {
+      for (const auto& buffer : buffers) {
+        num_bytes += buffer.size();
+      }
+      done = true;
+    }, loki::FileBatchOrder::ARCHIVE_OFFSET);
+
+    while (!done) {
+      std::this_thread::yield();
+    }
+
+    report("File manager, batch", files.size(), num_bytes, elapsed_seconds(start));
+  }
+
+  // End to end: request on the main thread, read and prepared on workers, uploaded back on the main thread
+  {
+    std::vector<std::shared_ptr<BenchmarkAsset>> assets;
+    std::vector<Clock::time_point> requested_times;
+    auto start = Clock::now();
+
+    for (const auto& file : files) {
+      auto asset = BenchmarkAsset::create(file.path);
+      requested_times.push_back(Clock::now());
+      asset->request_load_full();
+      assets.push_back(std::move(asset));
+    }
+
+    auto is_done = [&assets]() {
+      return std::all_of(assets.begin(), assets.end(), [](const std::shared_ptr<BenchmarkAsset>& asset) {
+        return asset->get_loading_state() != loki::AssetLoadingState::LOADING;
+      });
+    };
+
+    while (!is_done()) {
+      loki::MainThreadQueue::get_ref().perform_all_tasks();
+      std::this_thread::yield();
+    }
+
+    auto seconds = elapsed_seconds(start);
+
+    std::vector<double> latencies;
+    for (std::size_t i = 0; i < assets.size(); ++i) {
+      if (auto it = loaded_times.find(assets[i].get()); it != loaded_times.end()) {
+        latencies.push_back(std::chrono::duration<double>(it->second - requested_times[i]).count());
+      }
+    }
+
+    report("Assets", latencies.size(), 0, seconds);
+    report_latency("Asset load latency", latencies);
+  }
+
+  file_manager.term();
+  loki::JobSystem::get_ref().term();
+  return 0;
+}
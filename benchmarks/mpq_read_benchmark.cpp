@@ -0,0 +1,158 @@
+/*
+ * This file is part of the Loki Project.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <functional>
+
+#include "CLI/CLI.hpp"
+#include "engine/datasource/mpq/mpq_archive.h"
+#include "engine/datasource/mpq/mpq_chain.h"
+#include "engine/datasource/mpq/mpq_index.h"
+#include "engine/datasource/mpq/mpq_sector_reader.h"
+#include "engine/mt/job_system.h"
+#include "spdlog/spdlog.h"
+
+namespace {
+
+  struct Candidate
+  {
+    std::string path;
+    const loki::MPQIndex::Entry* entry;
+  };
+
+  struct Result
+  {
+    std::size_t num_files{ 0 };
+    std::size_t num_bytes{ 0 };
+    double seconds{ 0.0 };
+  };
+
+  auto measure(const std::vector<Candidate>& candidates, std::vector<loki::MPQArchive>& archives, const std::function<std::size_t(HANDLE, HANDLE, std::uint32_t)>& read)
+    -> Result
+  {
+    Result result;
+    auto start = std::chrono::steady_clock::now();
+
+    for (const auto& candidate : candidates) {
+      HANDLE archive = archives[candidate.entry->archive].get_handle();
+      HANDLE file{};
+      if (!SFileOpenFileEx(archive, candidate.path.c_str(), SFILE_OPEN_FROM_MPQ, &file)) {
+        continue;
+      }
+
+      if (auto size = read(archive, file, candidate.entry->archive)) {
+        result.num_bytes += size;
+        ++result.num_files;
+      }
+
+      SFileCloseFile(file);
+    }
+
+    result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return result;
+  }
+
+  void report(const std::string& name, const Result& result)
+  {
+    double megabytes = static_cast<double>(result.num_bytes) / (1024.0 * 1024.0);
+    spdlog::info("{:<20} {:>6} files {:>10.1f} MB {:>8.3f} s {:>10.1f} MB/s", name, result.num_files, megabytes, result.seconds,
+        result.seconds > 0.0 ? megabytes / result.seconds : 0.0);
+  }
+
+} // namespace
+
+int
+main(int argc, char* argv[])
+{
+  CLI::App app{ "Loki MPQ read benchmark" };
+  argv = app.ensure_utf8(argv);
+
+  std::filesystem::path data_dir;
+  std::size_t max_files = 200;
+  std::size_t iterations = 3;
+
+  app.add_option("--data", data_dir, "Directory with the MPQ archives")->required();
+  app.add_option("--max-files", max_files, "Number of big compressed files to read");
+  app.add_option("--iterations", iterations, "Runs per backend, the first one is usually cold");
+  CLI11_PARSE(app, argc, argv)
+
+  auto archive_paths = loki::MPQChain::find_archives(data_dir);
+  auto fingerprint = loki::MPQChain::get_fingerprint(archive_paths);
+
+  loki::MPQIndex index;
+  if (!index.load(data_dir.string() + ".index", fingerprint)) {
+    index = loki::MPQIndex::build(archive_paths);
+  }
+
+  // Only the files the sector reader accepts, so every backend reads exactly the same data
+  std::vector<Candidate> candidates;
+  for (const auto& [path, entry] : index.get_entries()) {
+    if (entry.size >= loki::MPQSectorReader::MIN_FILE_SIZE && !entry.requires_chain() && (entry.flags & MPQ_FILE_COMPRESS_MASK) &&
+        !(entry.flags & (MPQ_FILE_ENCRYPTED | MPQ_FILE_SINGLE_UNIT))) {
+      candidates.push_back({ path, &entry });
+    }
+  }
+
+  std::sort(candidates.begin(), candidates.end(), [](const Candidate& a, const Candidate& b) {
+    return std::tie(a.entry->archive, a.entry->block) < std::tie(b.entry->archive, b.entry->block);
+  });
+
+  if (candidates.size() > max_files) {
+    candidates.resize(max_files);
+  }
+
+  spdlog::info("Reading {} files from {} archives", candidates.size(), archive_paths.size());
+
+  std::vector<loki::MPQArchive> archives;
+  for (const auto& archive_path : archive_paths) {
+    archives.emplace_back(archive_path);
+  }
+
+  loki::JobSystem::get_ref().init(loki::JobSystem::get_default_num_workers());
+
+  auto stream_reader = loki::MPQRawReader::create(loki::MPQRawBackend::STREAM);
+  auto uring_reader = loki::MPQRawReader::create(loki::MPQRawBackend::IO_URING);
+
+  auto read_sectors = [&](loki::MPQRawReader& raw_reader) {
+    return [&](HANDLE archive, HANDLE file, std::uint32_t archive_index) -> std::size_t {
+      auto data = loki::MPQSectorReader::read(archive_paths[archive_index], archive, file, raw_reader);
+      return data ? data->size() : 0;
+    };
+  };
+
+  for (std::size_t i = 0; i < iterations; ++i) {
+    spdlog::info("Iteration {}", i + 1);
+
+    report("StormLib", measure(candidates, archives, [](HANDLE, HANDLE file, std::uint32_t) -> std::size_t {
+      std::vector<char> data(SFileGetFileSize(file, nullptr));
+      DWORD read = 0;
+      return SFileReadFile(file, data.data(), static_cast<DWORD>(data.size()), &read, nullptr) ? read : 0;
+    }));
+
+    report("Sectors (stream)", measure(candidates, archives, read_sectors(*stream_reader)));
+
+    // Without io_uring support the factory returns another stream reader, no point measuring it twice
+    if (uring_reader->get_backend() == loki::MPQRawBackend::IO_URING) {
+      report("Sectors (io_uring)", measure(candidates, archives, read_sectors(*uring_reader)));
+    }
+  }
+
+  loki::JobSystem::get_ref().term();
+
+  return 0;
+}
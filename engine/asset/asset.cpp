@@ -16,48 +16,406 @@
  */
 
 #include "asset.h"
+#include "engine/datasource/mpq/mpq_file_awaitables.h"
 #include "engine/datasource/mpq/mpq_file_manager.h"
+#include "engine/mt/job_system.h"
 #include "engine/mt/main_thread_queue.h"
 
-void
-loki::Asset::wait_load_full(const MPQFile& file)
+#include <algorithm>
+
+namespace {
+
+  // Uploads of visible assets go first when the main thread can't take all of them in one frame
+  auto get_upload_priority(loki::FileRequestPriority priority) -> loki::MainThreadTaskPriority
+  {
+    switch (priority) {
+      case loki::FileRequestPriority::HIGH:
+        return loki::MainThreadTaskPriority::HIGH;
+      case loki::FileRequestPriority::NORMAL:
+        return loki::MainThreadTaskPriority::NORMAL;
+      default:
+        return loki::MainThreadTaskPriority::LOW;
+    }
+  }
+
+} // namespace
+
+auto
+loki::Asset::load_full(std::weak_ptr<Asset> self, std::filesystem::path path, FileRequestPriority priority) -> Task<>
+{
+  // The asset itself is the cancellation token, nothing is read for an asset that is already gone
+  auto buffer = co_await read_file(std::move(path), priority, self);
+
+  // Parsing and decoding happen off the main thread, file workers are kept for reading
+  co_await switch_to_job_system();
+
+  auto result = LoadResult::FAILED;
+  if (auto asset = self.lock(); asset && buffer.is_valid() && asset->prepare(buffer.get_span())) {
+    result = LoadResult::PREPARED;
+  }
+
+  // The prepared data is all that's needed from here on, the file stops counting towards the in-flight bytes
+  buffer = FileBuffer();
+
+  co_await switch_to_main_thread(get_upload_priority(priority));
+
+  if (auto asset = self.lock()) {
+    asset->finish_load_full(result);
+  }
+}
+
+auto
+loki::Asset::load_batch(std::vector<std::weak_ptr<Asset>> batch, std::vector<std::filesystem::path> paths, FileRequestPriority priority,
+    FileRequestToken token) -> Task<>
+{
+  bool cancellable = MPQFileManager::is_token_set(token);
+  auto buffers = co_await read_files(std::move(paths), FileBatchOrder::ARCHIVE_OFFSET, priority, token);
+
+  co_await switch_to_job_system();
+
+  std::vector<LoadResult> results(batch.size(), LoadResult::FAILED);
+
+  JobSystem::get_ref().parallel_for(batch.size(), [&batch, &buffers, &results, cancellable, &token](std::size_t i) {
+    // A missing file fails, one that was never read because the token expired is only cancelled
+    if (!buffers[i].is_valid()) {
+      results[i] = cancellable && token.expired() ? LoadResult::CANCELLED : LoadResult::FAILED;
+    } else if (auto asset = batch[i].lock(); asset && asset->prepare(buffers[i].get_span())) {
+      results[i] = LoadResult::PREPARED;
+    }
+  });
+
+  buffers.clear();
+
+  // One main thread task for the whole batch
+  co_await switch_to_main_thread(get_upload_priority(priority));
+
+  for (std::size_t i = 0; i < batch.size(); ++i) {
+    if (auto asset = batch[i].lock()) {
+      asset->finish_load_full(results[i]);
+    }
+  }
+}
+
+auto
+loki::Asset::load(std::vector<std::shared_ptr<Asset>> assets, FileRequestPriority priority, FileRequestToken token) -> Task<>
 {
-  // Read file on the FileThread
-  std::vector<char> buffer;
-  file.read_all(buffer);
+  // Loading states are only touched on the main thread
+  co_await switch_to_main_thread(get_upload_priority(priority));
+
+  request_load_batch(assets, priority, token);
+
+  struct JoinAwaiter
+  {
+    const std::vector<std::shared_ptr<Asset>>& assets;
+    LoadJoin join{};
+
+    static auto is_pending(const std::shared_ptr<Asset>& asset) -> bool
+    {
+      return asset && !asset->tree_done && asset->loading_state != AssetLoadingState::NOT_LOADED;
+    }
+
+    auto await_ready() const -> bool
+    {
+      return std::none_of(assets.begin(), assets.end(), is_pending);
+    }
+
+    void await_suspend(std::coroutine_handle<> handle)
+    {
+      join.handle = handle;
+
+      for (const auto& asset : assets) {
+        if (is_pending(asset)) {
+          ++join.remaining;
+          asset->load_joins.push_back(&join);
+        }
+      }
+    }
 
-  auto self = weak_from_this();
-  auto task = [self, buffer = std::move(buffer)]() {
-    if (auto self_shared = self.lock()) {
-      self_shared->on_fully_loaded(buffer);
-      self_shared->loading_state = AssetLoadingState::LOADED_FULLY;
-      spdlog::info("Loaded file '{}'", self_shared->asset_path.to_string());
+    void await_resume() const
+    {
     }
   };
 
-  // But process it in the MainThread
-  MainThreadQueue::get_ref().add_task(std::move(task));
+  // The frame holds the assets, none of them can go away with the join registered
+  co_await JoinAwaiter{ assets };
+}
+
+auto
+loki::Asset::load_dependencies(std::weak_ptr<Asset> self, std::vector<std::shared_ptr<Asset>> dependencies, FileRequestPriority priority) -> Task<>
+{
+  // All dependencies go out as one batch: one file worker reads them in archive order and their prepare runs in parallel
+  // on the job system. They're shared through the registry, so the asset isn't their token, it going away mustn't cancel
+  // them for other parents. The ones somebody else's token cancelled are back to NOT_LOADED, only they go into the next batch
+  do {
+    co_await load(dependencies, priority);
+  } while (!self.expired() && std::any_of(dependencies.begin(), dependencies.end(), [](const std::shared_ptr<Asset>& dependency) {
+    return dependency->get_loading_state() == AssetLoadingState::NOT_LOADED;
+  }));
+
+  if (auto asset = self.lock()) {
+    asset->loading_dependencies = false;
+    asset->finish_tree(std::all_of(dependencies.begin(), dependencies.end(), [](const std::shared_ptr<Asset>& dependency) {
+      return dependency->is_resident();
+    }));
+  }
 }
 
 void
-loki::Asset::request_load_full()
+loki::Asset::add_dependency(std::shared_ptr<Asset> dependency)
 {
-  if (get_loading_state() != AssetLoadingState::NOT_LOADED) {
+  if (!dependency || std::find(dependencies.begin(), dependencies.end(), dependency) != dependencies.end()) {
+    return;
+  }
+
+  auto is_this = [this](const std::weak_ptr<Asset>& dependent) {
+    return dependent.lock().get() == this;
+  };
+
+  if (std::none_of(dependency->dependents.begin(), dependency->dependents.end(), is_this)) {
+    dependency->dependents.push_back(weak_from_this());
+  }
+
+  dependencies.push_back(std::move(dependency));
+}
+
+void
+loki::Asset::when_resident(ResidentCallback&& callback)
+{
+  if (tree_done) {
+    callback(resident);
     return;
   }
 
+  resident_callbacks.push_back(std::move(callback));
+}
+
+void
+loki::Asset::finish_load_full(LoadResult result)
+{
+  if (result == LoadResult::CANCELLED) {
+    spdlog::info("Cancelled loading '{}'", asset_path.to_string());
+    loading_state = AssetLoadingState::NOT_LOADED;
+
+    // The tree isn't done, but nothing is coming for the loads joined on it either
+    resume_load_joins();
+    return;
+  }
+
+  load_timings.self = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - request_time);
+
+  if (result == LoadResult::FAILED) {
+    spdlog::error("Failed to load file '{}'", asset_path.to_string());
+    loading_state = AssetLoadingState::FAILED;
+    finish_tree(false);
+    return;
+  }
+
+  upload();
+  loading_state = AssetLoadingState::LOADED_FULLY;
+  spdlog::info("Loaded file '{}'", asset_path.to_string());
+
+  // Counts as used, otherwise it could be evicted before anything had a chance to draw it
+  last_used_frame = AssetRegistry::get_ref().get_frame();
+
+  if (dependencies.empty()) {
+    finish_tree(true);
+    return;
+  }
+
+  start_loading_dependencies();
+}
+
+void
+loki::Asset::start_loading_dependencies()
+{
+  loading_dependencies = true;
+  load_dependencies(weak_from_this(), dependencies, get_load_priority()).start();
+}
+
+void
+loki::Asset::finish_tree(bool tree_resident)
+{
+  tree_done = true;
+  resident = tree_resident;
+  load_timings.tree = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - request_time);
+
+  if (!dependencies.empty()) {
+    spdlog::info("'{}' with {} dependencies {} in {:.1f} ms, own file in {:.1f} ms", asset_path.to_string(), dependencies.size(),
+        resident ? "loaded" : "failed", (double)load_timings.tree.count() / 1000.0, (double)load_timings.self.count() / 1000.0);
+  }
+
+  for (auto& callback : std::exchange(resident_callbacks, {})) {
+    callback(resident);
+  }
+
+  resume_load_joins();
+}
+
+void
+loki::Asset::resume_load_joins()
+{
+  for (auto* join : std::exchange(load_joins, {})) {
+    if (--join->remaining == 0) {
+      join->handle.resume();
+    }
+  }
+}
+
+void
+loki::Asset::start_loading(FileRequestPriority priority)
+{
   loading_state = AssetLoadingState::LOADING;
+  load_priority = priority;
+  request_time = std::chrono::steady_clock::now();
+}
+
+void
+loki::Asset::load_missing_dependencies()
+{
+  // The asset itself is still there, but a dependency was evicted
+  if (loading_state == AssetLoadingState::LOADED_FULLY && !tree_done && !loading_dependencies) {
+    start_loading_dependencies();
+  }
+}
+
+void
+loki::Asset::touch()
+{
+  mark_used(AssetRegistry::get_ref().get_frame());
+  request_load_full(load_priority);
+}
+
+void
+loki::Asset::mark_used(std::uint64_t frame)
+{
+  if (last_used_frame == frame) {
+    return;
+  }
+
+  last_used_frame = frame;
 
-  auto& file_manager = MPQFileManager::get_ref();
-  auto self = weak_from_this();
+  for (const auto& dependency : dependencies) {
+    dependency->mark_used(frame);
+  }
+}
 
-  file_manager.request_file(asset_path.to_string(), [self](MPQFile& file) {
-    if (auto self_shared = self.lock()) {
-      self_shared->wait_load_full(file);
-    } else {
-      spdlog::warn("Asset '{}' is already expired", file.get_name().to_string());
+auto
+loki::Asset::evict() -> bool
+{
+  if (loading_state != AssetLoadingState::LOADED_FULLY || loading_dependencies) {
+    return false;
+  }
+
+  // A parent waiting for its dependencies would end up with a tree that isn't there
+  for (const auto& dependent : dependents) {
+    if (auto parent = dependent.lock(); parent && parent->loading_dependencies) {
+      return false;
     }
-  });
+  }
+
+  release();
+  loading_state = AssetLoadingState::NOT_LOADED;
+  tree_done = false;
+  resident = false;
+
+  for (const auto& dependent : dependents) {
+    if (auto parent = dependent.lock()) {
+      parent->invalidate_tree();
+    }
+  }
+
+  spdlog::info("Evicted '{}'", asset_path.to_string());
+  return true;
+}
+
+void
+loki::Asset::invalidate_tree()
+{
+  if (!tree_done) {
+    return;
+  }
+
+  tree_done = false;
+  resident = false;
+
+  for (const auto& dependent : dependents) {
+    if (auto parent = dependent.lock()) {
+      parent->invalidate_tree();
+    }
+  }
+}
+
+void
+loki::Asset::request_load_full(FileRequestPriority priority)
+{
+  if (get_loading_state() != AssetLoadingState::NOT_LOADED) {
+    if (priority > load_priority) {
+      set_load_priority(priority);
+    }
+
+    load_missing_dependencies();
+    return;
+  }
+
+  start_loading(priority);
+
+  load_full(weak_from_this(), asset_path.to_string(), priority).start();
 
   spdlog::info("Loading file '{}'", asset_path.to_string());
 }
+
+void
+loki::Asset::set_load_priority(FileRequestPriority priority)
+{
+  if (priority == load_priority) {
+    return;
+  }
+
+  load_priority = priority;
+
+  if (get_loading_state() == AssetLoadingState::LOADING) {
+    MPQFileManager::get_ref().update_priority(asset_path.to_string(), priority);
+  }
+
+  // A model that became visible needs its textures as urgently as itself
+  for (const auto& dependency : dependencies) {
+    if (priority > dependency->load_priority) {
+      dependency->set_load_priority(priority);
+    }
+  }
+}
+
+void
+loki::Asset::request_load_batch(const std::vector<std::shared_ptr<Asset>>& assets, FileRequestPriority priority, const FileRequestToken& token)
+{
+  std::vector<std::weak_ptr<Asset>> batch;
+  std::vector<std::filesystem::path> paths;
+
+  for (const auto& asset : assets) {
+    if (!asset) {
+      continue;
+    }
+
+    if (asset->get_loading_state() != AssetLoadingState::NOT_LOADED) {
+      if (priority > asset->load_priority) {
+        asset->set_load_priority(priority);
+      }
+
+      asset->load_missing_dependencies();
+      continue;
+    }
+
+    asset->start_loading(priority);
+
+    batch.push_back(asset);
+    paths.emplace_back(asset->asset_path.to_string());
+  }
+
+  if (batch.empty()) {
+    return;
+  }
+
+  spdlog::info("Loading {} files in a batch", batch.size());
+
+  load_batch(std::move(batch), std::move(paths), priority, token).start();
+}
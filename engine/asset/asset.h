@@ -17,12 +17,19 @@
 
 #pragma once
 
-#include "engine/datasource/mpq/mpq_file.h"
+#include "engine/datasource/file_buffer.h"
+#include "engine/datasource/mpq/mpq_file_manager.h"
+#include "engine/mt/task.h"
+#include "asset_registry.h"
 #include "engine/utils/string_manager.h"
 #include "engine/utils/strings.h"
 
+#include <chrono>
+#include <coroutine>
 #include <filesystem>
+#include <functional>
 #include <mutex>
+#include <span>
 
 namespace loki {
 
@@ -31,10 +38,27 @@ namespace loki {
     NOT_LOADED,
     LOADING,
     LOADED_FULLY,
+    FAILED, // the file is missing or broken, it isn't requested again
   };
 
   class Asset : public std::enable_shared_from_this<Asset>
   {
+  public:
+    // Called on the main thread once the asset and all of its dependencies are done, resident tells if all of them loaded
+    using ResidentCallback = std::function<void(bool resident)>;
+
+    struct LoadTimings
+    {
+      std::chrono::microseconds self{ 0 }; // from the request to the upload of the asset's own file
+      std::chrono::microseconds tree{ 0 }; // from the request until every dependency is resident too
+    };
+
+    struct MemoryUsage
+    {
+      std::size_t cpu{ 0 };
+      std::size_t gpu{ 0 };
+    };
+
   public:
     explicit Asset(const Asset&) = delete;
     Asset& operator=(const Asset&) = delete;
@@ -52,10 +76,76 @@ namespace loki {
       return get_loading_state() == AssetLoadingState::LOADED_FULLY;
     }
 
-    void request_load_full();
+    // The asset and its whole dependency tree are loaded, this is what's needed to draw it
+    auto is_resident() const -> bool
+    {
+      return tree_done && resident;
+    }
+
+    // The tree finished loading, successfully or not
+    auto is_tree_done() const -> bool
+    {
+      return tree_done;
+    }
+
+    auto get_dependencies() const -> const std::vector<std::shared_ptr<Asset>>&
+    {
+      return dependencies;
+    }
+
+    auto get_load_timings() const -> const LoadTimings&
+    {
+      return load_timings;
+    }
+
+    // Runs right away if the tree is already done
+    void when_resident(ResidentCallback&& callback);
+
+    // Memory held by the asset itself, not counting its dependencies. Nothing while it isn't loaded
+    virtual auto get_memory_usage() const -> MemoryUsage = 0;
+
+    // Call when the asset is drawn: marks it and its dependencies as used this frame, so they're the last to be evicted,
+    // and requests again whatever was evicted. The file cache usually still has the files, so that's cheap
+    void touch();
+
+    auto get_last_used_frame() const -> std::uint64_t
+    {
+      return last_used_frame;
+    }
+
+    void request_load_full(FileRequestPriority priority = FileRequestPriority::NORMAL);
+
+    // Loads several assets through one file request, their files are read in the order they're stored in the archives
+    static void request_load_batch(const std::vector<std::shared_ptr<Asset>>& assets, FileRequestPriority priority = FileRequestPriority::NORMAL,
+        const FileRequestToken& token = {});
+
+    // Loads the assets that aren't loaded yet and continues on the main thread once the trees of all of them are done, resident or failed.
+    // Assets whose reads the token cancelled go back to NOT_LOADED, they can be requested again
+    static auto load(std::vector<std::shared_ptr<Asset>> assets, FileRequestPriority priority = FileRequestPriority::NORMAL,
+        FileRequestToken token = {}) -> Task<>;
+
+    // Visible assets should be bumped so they jump the queue of pending file requests, hidden ones can be lowered
+    void set_load_priority(FileRequestPriority priority);
+
+    auto get_load_priority() const -> FileRequestPriority
+    {
+      return load_priority;
+    }
 
   protected:
-    virtual void on_fully_loaded(const std::vector<char>& buffer) = 0;
+    // Runs on a worker thread and turns the file into CPU-ready data, returns false if the file is broken.
+    // Must not call OpenGL or touch the loading state of other assets
+    virtual auto prepare(std::span<const char> buffer) -> bool = 0;
+
+    // Runs on the main thread once prepare succeeded, only the work that needs the GL context belongs here.
+    // Dependencies declared here are loaded together right after it. They must not depend on this asset in turn
+    virtual void upload() = 0;
+
+    // Frees everything prepare and upload produced, on the main thread. The asset is NOT_LOADED afterwards.
+    // Dependencies are kept, they are evicted on their own
+    virtual void release() = 0;
+
+    void add_dependency(std::shared_ptr<Asset> dependency);
 
   protected:
     StringId asset_path;
@@ -63,25 +153,72 @@ namespace loki {
   protected:
     explicit Asset()
       : loading_state(AssetLoadingState::NOT_LOADED)
+      , load_priority(FileRequestPriority::NORMAL)
     {
     }
 
   private:
-    void wait_load_full(const MPQFile& file);
+    friend class AssetRegistry;
+
+    enum class LoadResult
+    {
+      PREPARED,
+      FAILED,
+      CANCELLED, // the read was dropped because its token expired, nothing is wrong with the file
+    };
+
+    // A coroutine waiting for several asset trees, resumed by the last of them to finish
+    struct LoadJoin
+    {
+      std::size_t remaining{ 0 };
+      std::coroutine_handle<> handle{};
+    };
+
+  private:
+    static auto load_full(std::weak_ptr<Asset> self, std::filesystem::path path, FileRequestPriority priority) -> Task<>;
+    static auto load_batch(std::vector<std::weak_ptr<Asset>> batch, std::vector<std::filesystem::path> paths, FileRequestPriority priority,
+        FileRequestToken token) -> Task<>;
+    static auto load_dependencies(std::weak_ptr<Asset> self, std::vector<std::shared_ptr<Asset>> dependencies, FileRequestPriority priority) -> Task<>;
+    void finish_load_full(LoadResult result);
+    void finish_tree(bool tree_resident);
+    void resume_load_joins();
+    void start_loading(FileRequestPriority priority);
+    void start_loading_dependencies();
+    void load_missing_dependencies();
+    void mark_used(std::uint64_t frame);
+
+    // Back to NOT_LOADED, returns false if the asset is still needed by a load in progress
+    auto evict() -> bool;
+    void invalidate_tree();
 
   private:
     AssetLoadingState loading_state;
+    FileRequestPriority load_priority;
+    std::vector<LoadJoin*> load_joins;
+    std::vector<std::shared_ptr<Asset>> dependencies;
+    std::vector<std::weak_ptr<Asset>> dependents; // assets this one is a dependency of
+    std::vector<ResidentCallback> resident_callbacks;
+    bool tree_done{ false };
+    bool resident{ false };
+    bool loading_dependencies{ false };
+    std::uint64_t last_used_frame{ 0 };
+    std::chrono::steady_clock::time_point request_time{};
+    LoadTimings load_timings{};
   };
 
   template<typename AssetType>
   class AssetWrapper : public Asset
   {
   public:
+    // Returns the live instance if there is one, so a file shared by several models is read and uploaded once
     static auto create(const std::filesystem::path& path) -> std::shared_ptr<AssetType>
     {
-      auto result = std::make_shared<AssetType>();
-      result->asset_path = StringId(to_uppercase(path.string()));
-      return result;
+      StringId asset_path(to_uppercase(path.string()));
+      return AssetRegistry::get_ref().get_or_create<AssetType>(asset_path, [&asset_path]() {
+        auto result = std::make_shared<AssetType>();
+        result->asset_path = asset_path;
+        return result;
+      });
     }
   };
 
@@ -0,0 +1,163 @@
+/*
+ * This file is part of the Loki Project.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "asset_registry.h"
+
+#include "asset.h"
+
+#include <algorithm>
+
+auto
+loki::AssetRegistry::get_stats() -> AssetRegistryStats
+{
+  std::lock_guard lock(mutex);
+  prune();
+
+  AssetRegistryStats stats;
+  stats.reused = reused;
+  stats.created = created;
+  stats.num_live = assets.size();
+
+  return stats;
+}
+
+void
+loki::AssetRegistry::prune()
+{
+  std::erase_if(assets, [](const auto& entry) {
+    return entry.second.expired();
+  });
+
+  inserts_since_prune = 0;
+}
+
+auto
+loki::AssetRegistry::get_memory_stats() -> std::vector<AssetMemoryStats>
+{
+  std::lock_guard lock(mutex);
+
+  std::unordered_map<std::type_index, AssetMemoryStats> stats_by_type;
+
+  for (const auto& [type, type_budget] : budgets) {
+    auto& stats = stats_by_type[type];
+    stats.type_name = type_budget.type_name;
+    stats.budget = type_budget.budget;
+    stats.evictions = type_budget.evictions;
+  }
+
+  for (const auto& [key, weak_asset] : assets) {
+    auto asset = weak_asset.lock();
+    if (!asset || !asset->is_loaded()) {
+      continue;
+    }
+
+    auto& stats = stats_by_type[key.type];
+    if (stats.type_name.empty()) {
+      stats.type_name = key.type.name();
+    }
+
+    auto usage = asset->get_memory_usage();
+    stats.cpu += usage.cpu;
+    stats.gpu += usage.gpu;
+    ++stats.num_loaded;
+  }
+
+  std::vector<AssetMemoryStats> result;
+  for (auto& [type, stats] : stats_by_type) {
+    result.push_back(std::move(stats));
+  }
+
+  std::sort(result.begin(), result.end(), [](const AssetMemoryStats& a, const AssetMemoryStats& b) {
+    return a.type_name < b.type_name;
+  });
+
+  return result;
+}
+
+void
+loki::AssetRegistry::evict_to_budgets()
+{
+  struct Candidate
+  {
+    std::shared_ptr<Asset> asset;
+    std::size_t size;
+  };
+
+  struct TypeUsage
+  {
+    std::size_t size{ 0 };
+    std::vector<Candidate> candidates;
+  };
+
+  std::unordered_map<std::type_index, TypeUsage> usage_by_type;
+
+  {
+    std::lock_guard lock(mutex);
+
+    for (const auto& [key, weak_asset] : assets) {
+      auto budget = budgets.find(key.type);
+      if (budget == budgets.end() || !budget->second.budget) {
+        continue;
+      }
+
+      auto asset = weak_asset.lock();
+      if (!asset || !asset->is_loaded()) {
+        continue;
+      }
+
+      auto usage = asset->get_memory_usage();
+      auto& type_usage = usage_by_type[key.type];
+      type_usage.size += usage.cpu + usage.gpu;
+
+      if (asset->get_last_used_frame() + EVICTION_GRACE_FRAMES < frame) {
+        type_usage.candidates.push_back({ std::move(asset), usage.cpu + usage.gpu });
+      }
+    }
+  }
+
+  // Evicting releases GL objects and may free the asset, neither should happen with the registry locked
+  for (auto& [type, type_usage] : usage_by_type) {
+    std::size_t budget;
+    {
+      std::lock_guard lock(mutex);
+      budget = budgets[type].budget;
+    }
+
+    if (type_usage.size <= budget) {
+      continue;
+    }
+
+    std::sort(type_usage.candidates.begin(), type_usage.candidates.end(), [](const Candidate& a, const Candidate& b) {
+      return a.asset->get_last_used_frame() < b.asset->get_last_used_frame();
+    });
+
+    std::size_t num_evicted = 0;
+    for (auto& candidate : type_usage.candidates) {
+      if (type_usage.size <= budget) {
+        break;
+      }
+
+      if (candidate.asset->evict()) {
+        type_usage.size -= std::min(type_usage.size, candidate.size);
+        ++num_evicted;
+      }
+    }
+
+    std::lock_guard lock(mutex);
+    budgets[type].evictions += num_evicted;
+  }
+}
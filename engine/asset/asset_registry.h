@@ -0,0 +1,159 @@
+/*
+ * This file is part of the Loki Project.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <typeindex>
+#include <unordered_map>
+#include <vector>
+
+#include "engine/utils/string_manager.h"
+
+namespace loki {
+
+  class Asset;
+
+  struct AssetRegistryStats
+  {
+    std::size_t reused{ 0 };
+    std::size_t created{ 0 };
+    std::size_t num_live{ 0 };
+  };
+
+  struct AssetMemoryStats
+  {
+    std::string type_name;
+    std::size_t num_loaded{ 0 };
+    std::size_t cpu{ 0 };
+    std::size_t gpu{ 0 };
+    std::size_t budget{ 0 }; // CPU and GPU together, 0 means no limit
+    std::size_t evictions{ 0 };
+  };
+
+  // Every live asset by its type and path, so everybody asking for the same file shares one instance.
+  // Only weak references are kept, an asset nobody uses is freed as usual
+  class AssetRegistry
+  {
+    struct Key
+    {
+      std::type_index type;
+      StringId path;
+
+      auto operator==(const Key& other) const -> bool = default;
+    };
+
+    struct KeyHash
+    {
+      auto operator()(const Key& key) const -> std::size_t
+      {
+        return key.type.hash_code() ^ (std::hash<StringId>{}(key.path) * 31);
+      }
+    };
+
+  public:
+    static AssetRegistry& get_ref()
+    {
+      static AssetRegistry registry{};
+      return registry;
+    }
+
+    template<typename AssetType>
+    auto get_or_create(StringId path, const std::function<std::shared_ptr<AssetType>()>& create) -> std::shared_ptr<AssetType>
+    {
+      Key key{ typeid(AssetType), path };
+
+      std::lock_guard lock(mutex);
+
+      auto& entry = assets[key];
+      if (auto existing = entry.lock()) {
+        ++reused;
+        return std::static_pointer_cast<AssetType>(existing);
+      }
+
+      auto asset = create();
+      entry = asset;
+      ++created;
+
+      // Expired entries are only dropped now and then, a lookup never pays for it
+      if (++inserts_since_prune >= PRUNE_INTERVAL) {
+        prune();
+      }
+
+      return asset;
+    }
+
+    auto get_stats() -> AssetRegistryStats;
+
+    // Memory of the loaded assets of every type, a type with a budget is listed even if nothing of it is loaded
+    auto get_memory_stats() -> std::vector<AssetMemoryStats>;
+
+    // Loaded assets of the type are evicted, least recently drawn first, once their memory is over the budget
+    template<typename AssetType>
+    void set_budget(std::string type_name, std::size_t budget)
+    {
+      std::lock_guard lock(mutex);
+
+      auto& type_budget = budgets[typeid(AssetType)];
+      type_budget.type_name = std::move(type_name);
+      type_budget.budget = budget;
+    }
+
+    // Main thread only, both of them. Frames count the draws Asset::touch records
+    void begin_frame()
+    {
+      ++frame;
+    }
+
+    void evict_to_budgets();
+
+    auto get_frame() const -> std::uint64_t
+    {
+      return frame;
+    }
+
+  private:
+    struct TypeBudget
+    {
+      std::string type_name;
+      std::size_t budget{ 0 };
+      std::size_t evictions{ 0 };
+    };
+
+  private:
+    explicit AssetRegistry() = default;
+
+    void prune();
+
+  private:
+    static constexpr std::size_t PRUNE_INTERVAL = 256;
+    static constexpr std::uint64_t EVICTION_GRACE_FRAMES = 2; // assets drawn this recently are never evicted
+
+    std::mutex mutex;
+    std::unordered_map<Key, std::weak_ptr<Asset>, KeyHash> assets;
+    std::size_t reused{ 0 };
+    std::size_t created{ 0 };
+    std::size_t inserts_since_prune{ 0 };
+    std::unordered_map<std::type_index, TypeBudget> budgets;
+    std::uint64_t frame{ 1 };
+  };
+
+} // namespace loki
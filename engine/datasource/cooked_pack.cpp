@@ -0,0 +1,261 @@
+/*
+ * This file is part of the Loki Project.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "cooked_pack.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+
+#include "lz4.h"
+#include "lz4hc.h"
+#include "spdlog/spdlog.h"
+
+namespace {
+
+  constexpr std::uint32_t PACK_MAGIC = 0x4B504B4C; // LKPK
+  constexpr std::uint32_t PACK_VERSION = 1;
+  constexpr std::uint64_t PAGE_SIZE = 4096;
+  constexpr std::uint16_t FLAG_LZ4 = 0x1;
+
+  // Followed by the chain fingerprint, the entry table sorted by path, the path strings and the page aligned file data
+  struct Header
+  {
+    std::uint32_t magic;
+    std::uint32_t version;
+    std::uint32_t num_entries;
+    std::uint32_t fingerprint_size;
+    std::uint64_t entries_offset;
+    std::uint64_t strings_offset;
+  };
+
+  struct Entry
+  {
+    std::uint64_t data_offset;
+    std::uint32_t stored_size;
+    std::uint32_t size;
+    std::uint32_t path_offset;
+    std::uint16_t path_size;
+    std::uint16_t flags;
+  };
+
+  static_assert(sizeof(Header) == 32 && sizeof(Entry) == 24);
+
+  auto align_up(std::uint64_t value, std::uint64_t alignment) -> std::uint64_t
+  {
+    return (value + alignment - 1) / alignment * alignment;
+  }
+
+  auto get_header(const loki::MappedFile& mapping) -> const Header*
+  {
+    return reinterpret_cast<const Header*>(mapping.data());
+  }
+
+  auto get_entries(const loki::MappedFile& mapping) -> std::span<const Entry>
+  {
+    const auto* header = get_header(mapping);
+    return { reinterpret_cast<const Entry*>(mapping.data() + header->entries_offset), header->num_entries };
+  }
+
+  auto get_path(const loki::MappedFile& mapping, const Entry& entry) -> std::string_view
+  {
+    return { mapping.data() + get_header(mapping)->strings_offset + entry.path_offset, entry.path_size };
+  }
+
+} // namespace
+
+auto
+loki::CookedPack::open(const std::filesystem::path& pack_path, const std::string& chain_fingerprint) -> bool
+{
+  auto pack_mapping = std::make_shared<MappedFile>(pack_path);
+  if (!pack_mapping->is_valid() || pack_mapping->size() < sizeof(Header)) {
+    spdlog::error("Cannot open the cooked pack '{}'", pack_path.string());
+    return false;
+  }
+
+  const auto* header = get_header(*pack_mapping);
+  if (header->magic != PACK_MAGIC || header->version != PACK_VERSION) {
+    spdlog::error("'{}' is not a cooked pack", pack_path.string());
+    return false;
+  }
+
+  auto size = pack_mapping->size();
+  auto entries_end = header->entries_offset + std::uint64_t(header->num_entries) * sizeof(Entry);
+  if (sizeof(Header) + header->fingerprint_size > size || header->entries_offset % alignof(Entry) || entries_end > header->strings_offset ||
+      header->strings_offset > size) {
+    spdlog::error("Cooked pack '{}' is corrupted", pack_path.string());
+    return false;
+  }
+
+  std::string_view fingerprint(pack_mapping->data() + sizeof(Header), header->fingerprint_size);
+  if (fingerprint != chain_fingerprint) {
+    spdlog::info("Cooked pack '{}' is outdated", pack_path.string());
+    return false;
+  }
+
+  // Validated once here, so lookups don't have to check bounds
+  for (const auto& entry : get_entries(*pack_mapping)) {
+    if (header->strings_offset + entry.path_offset + entry.path_size > size || entry.data_offset + entry.stored_size > size) {
+      spdlog::error("Cooked pack '{}' is corrupted", pack_path.string());
+      return false;
+    }
+  }
+
+  mapping = std::move(pack_mapping);
+  spdlog::info("Cooked pack is opened: {} files", get_num_files());
+
+  return true;
+}
+
+auto
+loki::CookedPack::write(const std::filesystem::path& pack_path, const std::string& chain_fingerprint, std::vector<File>&& files, bool compress) -> bool
+{
+  std::sort(files.begin(), files.end(), [](const File& a, const File& b) {
+    return a.path < b.path;
+  });
+
+  files.erase(std::unique(files.begin(), files.end(),
+                  [](const File& a, const File& b) {
+                    return a.path == b.path;
+                  }),
+      files.end());
+
+  Header header{};
+  header.magic = PACK_MAGIC;
+  header.version = PACK_VERSION;
+  header.num_entries = static_cast<std::uint32_t>(files.size());
+  header.fingerprint_size = static_cast<std::uint32_t>(chain_fingerprint.size());
+  header.entries_offset = align_up(sizeof(Header) + chain_fingerprint.size(), alignof(Entry));
+  header.strings_offset = header.entries_offset + files.size() * sizeof(Entry);
+
+  std::vector<Entry> entries(files.size());
+  std::string strings;
+  std::vector<std::vector<char>> blobs(files.size());
+
+  for (std::size_t i = 0; i < files.size(); ++i) {
+    auto& file = files[i];
+    auto& entry = entries[i];
+
+    entry.path_offset = static_cast<std::uint32_t>(strings.size());
+    entry.path_size = static_cast<std::uint16_t>(file.path.size());
+    entry.size = static_cast<std::uint32_t>(file.data.size());
+    strings += file.path;
+
+    // Stored as is unless LZ4 saves at least an eighth, a view into the mapping beats a small gain
+    if (compress && !file.data.empty() && file.data.size() <= LZ4_MAX_INPUT_SIZE) {
+      auto source_size = static_cast<int>(file.data.size());
+      std::vector<char> compressed(LZ4_compressBound(source_size));
+      int compressed_size = LZ4_compress_HC(file.data.data(), compressed.data(), source_size, static_cast<int>(compressed.size()), LZ4HC_CLEVEL_DEFAULT);
+      if (compressed_size > 0 && static_cast<std::size_t>(compressed_size) < file.data.size() - file.data.size() / 8) {
+        compressed.resize(compressed_size);
+        blobs[i] = std::move(compressed);
+        entry.flags |= FLAG_LZ4;
+      }
+    }
+
+    if (!(entry.flags & FLAG_LZ4)) {
+      blobs[i] = std::move(file.data);
+    }
+
+    entry.stored_size = static_cast<std::uint32_t>(blobs[i].size());
+  }
+
+  auto offset = align_up(header.strings_offset + strings.size(), PAGE_SIZE);
+  for (std::size_t i = 0; i < entries.size(); ++i) {
+    entries[i].data_offset = offset;
+    offset = align_up(offset + entries[i].stored_size, PAGE_SIZE);
+  }
+
+  auto temp_path = pack_path;
+  temp_path += ".tmp";
+
+  {
+    std::ofstream stream(temp_path, std::ios::binary | std::ios::trunc);
+
+    auto pad_to = [&stream](std::uint64_t position) {
+      auto current = static_cast<std::uint64_t>(stream.tellp());
+      if (position > current) {
+        std::vector<char> padding(position - current, 0);
+        stream.write(padding.data(), static_cast<std::streamsize>(padding.size()));
+      }
+    };
+
+    stream.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    stream.write(chain_fingerprint.data(), static_cast<std::streamsize>(chain_fingerprint.size()));
+    pad_to(header.entries_offset);
+    stream.write(reinterpret_cast<const char*>(entries.data()), static_cast<std::streamsize>(entries.size() * sizeof(Entry)));
+    stream.write(strings.data(), static_cast<std::streamsize>(strings.size()));
+
+    for (std::size_t i = 0; i < entries.size(); ++i) {
+      pad_to(entries[i].data_offset);
+      stream.write(blobs[i].data(), static_cast<std::streamsize>(blobs[i].size()));
+    }
+
+    if (!stream) {
+      spdlog::error("Failed to write the cooked pack '{}'", pack_path.string());
+      return false;
+    }
+  }
+
+  std::error_code error;
+  std::filesystem::rename(temp_path, pack_path, error);
+
+  return !error;
+}
+
+auto
+loki::CookedPack::find(std::string_view path) const -> FileBuffer
+{
+  if (!mapping) {
+    return FileBuffer();
+  }
+
+  auto entries = get_entries(*mapping);
+  auto it = std::lower_bound(entries.begin(), entries.end(), path, [this](const Entry& entry, std::string_view value) {
+    return get_path(*mapping, entry) < value;
+  });
+
+  if (it == entries.end() || get_path(*mapping, *it) != path) {
+    return FileBuffer();
+  }
+
+  auto stored = mapping->get_span().subspan(it->data_offset, it->stored_size);
+  if (!(it->flags & FLAG_LZ4)) {
+    return FileBuffer(mapping, stored);
+  }
+
+  std::vector<char> data(it->size);
+  int size = LZ4_decompress_safe(stored.data(), data.data(), static_cast<int>(stored.size()), static_cast<int>(data.size()));
+  if (size != static_cast<int>(data.size())) {
+    spdlog::error("Failed to decompress '{}' from the cooked pack", path);
+    return FileBuffer();
+  }
+
+  return FileBuffer(std::move(data));
+}
+
+auto
+loki::CookedPack::get_num_files() const -> std::size_t
+{
+  return mapping ? get_header(*mapping)->num_entries : 0;
+}
+
+auto
+loki::CookedPack::contains(const FileBuffer& buffer) const -> bool
+{
+  return mapping && buffer.data() >= mapping->data() && buffer.data() < mapping->data() + mapping->size();
+}
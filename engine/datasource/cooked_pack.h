@@ -0,0 +1,68 @@
+/*
+ * This file is part of the Loki Project.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "engine/utils/mapped_file.h"
+#include "file_buffer.h"
+
+namespace loki {
+
+  // A single flat file with the hot files of a patch chain, cooked offline. Paths are sorted for a binary search,
+  // every file starts on its own page and is either stored as is, handed out as a view into the mapping, or LZ4 compressed
+  class CookedPack
+  {
+  public:
+    struct File
+    {
+      std::string path; // normalized like MPQIndex paths
+      std::vector<char> data;
+    };
+
+  public:
+    explicit CookedPack() = default;
+
+  public:
+    // The pack is rejected if it was cooked from another chain
+    auto open(const std::filesystem::path& pack_path, const std::string& chain_fingerprint) -> bool;
+    static auto write(const std::filesystem::path& pack_path, const std::string& chain_fingerprint, std::vector<File>&& files, bool compress) -> bool;
+
+    auto is_open() const -> bool
+    {
+      return mapping != nullptr;
+    }
+
+    // Expects a normalized path, returns an invalid buffer if the pack doesn't have the file
+    auto find(std::string_view path) const -> FileBuffer;
+
+    auto get_num_files() const -> std::size_t;
+
+    // True if the buffer is a view into the pack
+    auto contains(const FileBuffer& buffer) const -> bool;
+
+  private:
+    std::shared_ptr<MappedFile> mapping;
+  };
+
+} // namespace loki
@@ -0,0 +1,80 @@
+/*
+ * This file is part of the Loki Project.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <memory>
+#include <span>
+#include <vector>
+
+namespace loki {
+
+  // Read-only view of a file's content that keeps its storage alive, so one read can be handed to many consumers without copies
+  class FileBuffer
+  {
+  public:
+    explicit FileBuffer() = default;
+
+    explicit FileBuffer(std::vector<char>&& data)
+    {
+      auto storage = std::make_shared<const std::vector<char>>(std::move(data));
+      bytes = std::span<const char>(storage->data(), storage->size());
+      owner = std::move(storage);
+    }
+
+    explicit FileBuffer(std::shared_ptr<const void> owner, std::span<const char> bytes)
+      : owner(std::move(owner))
+      , bytes(bytes)
+    {
+    }
+
+  public:
+    auto is_valid() const -> bool
+    {
+      return owner != nullptr;
+    }
+
+    auto data() const -> const char*
+    {
+      return bytes.data();
+    }
+
+    auto size() const -> std::size_t
+    {
+      return bytes.size();
+    }
+
+    auto get_span() const -> std::span<const char>
+    {
+      return bytes;
+    }
+
+    // Shares the storage, the range is clamped to the buffer
+    auto slice(std::size_t offset, std::size_t length) const -> FileBuffer
+    {
+      offset = std::min(offset, bytes.size());
+      length = std::min(length, bytes.size() - offset);
+      return FileBuffer(owner, bytes.subspan(offset, length));
+    }
+
+  private:
+    std::shared_ptr<const void> owner{};
+    std::span<const char> bytes{};
+  };
+
+} // namespace loki
@@ -33,3 +33,12 @@ loki::MPQArchive::patch(const std::filesystem::path& path, const std::string& pr
   DEBUG_ASSERT(is_valid(), "Cannot apply a patch to an invalid MPQ archive", this);
   return SFileOpenPatchArchive(handle, path.string().c_str(), prefix.c_str(), 0);
 }
+
+void
+loki::MPQArchive::close()
+{
+  if (is_valid()) {
+    SFileCloseArchive(handle);
+    handle = HANDLE{};
+  }
+}
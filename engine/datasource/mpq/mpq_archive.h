@@ -45,6 +45,7 @@ namespace loki {
     }
 
     auto patch(const std::filesystem::path& path, const std::string& prefix = "") -> bool;
+    void close();
 
   private:
     HANDLE handle{};
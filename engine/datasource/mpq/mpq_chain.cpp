@@ -17,13 +17,34 @@
 
 #include "mpq_chain.h"
 
+#include "engine/crypto/crypto_hash.h"
+#include "engine/utils/strings.h"
 #include "glob/glob.h"
 #include "spdlog/spdlog.h"
 
 loki::MPQChain::MPQChain(const std::filesystem::path& data_dir)
+  : MPQChain(find_archives(data_dir))
 {
-  namespace fs = std::filesystem;
+}
+
+loki::MPQChain::MPQChain(const std::vector<std::filesystem::path>& archive_paths)
+{
+  for (const auto& path : archive_paths) {
+    if (archive.is_valid()) {
+      if (!archive.patch(path)) {
+        spdlog::error("Error patching: {}", path.filename().string());
+      }
+    } else {
+      archive = MPQArchive(path);
+    }
+  }
+
+  spdlog::info("MPQ chain loading done!");
+}
 
+auto
+loki::MPQChain::find_archives(const std::filesystem::path& data_dir) -> std::vector<std::filesystem::path>
+{
   static std::vector<std::string> patterns = { "common.MPQ", "common-2.MPQ", "expansion.MPQ", "lichking.MPQ", "*/locale-*.MPQ", "*/speech-*.MPQ", "*/expansion-locale-*.MPQ",
     "*/lichking-locale-*.MPQ", "*/expansion-speech-*.MPQ", "*/lichking-speech-*.MPQ", "*/patch-????.MPQ", "*/patch-*.MPQ", "patch.MPQ", "patch-*.MPQ" };
 
@@ -33,17 +54,34 @@ loki::MPQChain::MPQChain(const std::filesystem::path& data_dir)
     full_patterns.push_back(full_path.string());
   }
 
-  for (const auto& path : glob::glob(full_patterns)) {
+  auto archive_paths = glob::glob(full_patterns);
+  for (const auto& path : archive_paths) {
     spdlog::info("Found a MPQ file: {}", path.filename().string());
+  }
 
-    if (archive.is_valid()) {
-      if (!archive.patch(path)) {
-        spdlog::error("Error patching: {}", path.filename().string());
-      }
-    } else {
-      archive = MPQArchive(path);
-    }
+  return archive_paths;
+}
+
+auto
+loki::MPQChain::get_fingerprint(const std::vector<std::filesystem::path>& archive_paths) -> std::string
+{
+  crypto::SHA1 hash;
+
+  for (const auto& path : archive_paths) {
+    std::error_code error;
+    auto file_size = std::filesystem::file_size(path, error);
+    auto write_time = std::filesystem::last_write_time(path, error).time_since_epoch().count();
+
+    hash.update_data(path.generic_string());
+    hash.update_data(fmt::format(":{}:{};", file_size, write_time));
   }
 
-  spdlog::info("MPQ chain loading done!");
+  hash.finalize();
+  return to_hex(hash.get_digest());
+}
+
+void
+loki::MPQChain::close()
+{
+  archive.close();
 }
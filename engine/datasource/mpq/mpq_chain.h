@@ -19,6 +19,7 @@
 
 #include <filesystem>
 #include <string>
+#include <vector>
 
 #include "mpq_archive.h"
 #include "mpq_file.h"
@@ -30,13 +31,22 @@ namespace loki {
   public:
     explicit MPQChain() = default;
     explicit MPQChain(const std::filesystem::path& data_dir);
+    explicit MPQChain(const std::vector<std::filesystem::path>& archive_paths);
 
   public:
+    // Returns the archives of the data directory in the order they have to be patched
+    static auto find_archives(const std::filesystem::path& data_dir) -> std::vector<std::filesystem::path>;
+
+    // Changes whenever an archive is added, removed, reordered or modified, without opening any of them
+    static auto get_fingerprint(const std::vector<std::filesystem::path>& archive_paths) -> std::string;
+
     auto get_archive() const -> MPQArchive
     {
       return archive;
     }
 
+    void close();
+
   private:
     MPQArchive archive{};
   };
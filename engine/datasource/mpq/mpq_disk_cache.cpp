@@ -0,0 +1,116 @@
+/*
+ * This file is part of the Loki Project.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "mpq_disk_cache.h"
+
+#include <fstream>
+#include <thread>
+
+#include "engine/crypto/crypto_hash.h"
+#include "engine/utils/strings.h"
+#include "engine/utils/mapped_file.h"
+#include "spdlog/spdlog.h"
+
+void
+loki::MPQDiskCache::open(const std::filesystem::path& cache_dir, const std::string& chain_fingerprint)
+{
+  std::error_code error;
+  std::filesystem::create_directories(cache_dir, error);
+  if (error) {
+    spdlog::error("Cannot create the cache directory '{}': {}", cache_dir.string(), error.message());
+    return;
+  }
+
+  root_dir = cache_dir;
+  fingerprint = chain_fingerprint;
+
+  spdlog::info("Disk cache: '{}', chain fingerprint {}", root_dir.string(), fingerprint);
+}
+
+auto
+loki::MPQDiskCache::find(StringId path) -> FileBuffer
+{
+  if (!is_enabled()) {
+    return FileBuffer();
+  }
+
+  auto mapping = std::make_shared<MappedFile>(get_entry_path(path));
+  if (!mapping->is_valid()) {
+    ++misses;
+    return FileBuffer();
+  }
+
+  ++hits;
+  auto bytes = mapping->get_span();
+  return FileBuffer(std::move(mapping), bytes);
+}
+
+void
+loki::MPQDiskCache::store(StringId path, const FileBuffer& buffer)
+{
+  if (!is_enabled() || !buffer.is_valid() || buffer.size() == 0) {
+    return;
+  }
+
+  auto entry_path = get_entry_path(path);
+
+  std::error_code error;
+  std::filesystem::create_directories(entry_path.parent_path(), error);
+
+  // Write aside and rename, so a concurrent reader or a crash never sees a truncated entry
+  auto temp_path = entry_path;
+  temp_path += fmt::format(".{}.tmp", std::hash<std::thread::id>{}(std::this_thread::get_id()));
+
+  {
+    std::ofstream stream(temp_path, std::ios::binary | std::ios::trunc);
+    stream.write(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+    if (!stream) {
+      spdlog::error("Failed to write the cache entry for '{}'", path.to_string());
+      stream.close();
+      std::filesystem::remove(temp_path, error);
+      return;
+    }
+  }
+
+  std::filesystem::rename(temp_path, entry_path, error);
+  if (error) {
+    std::filesystem::remove(temp_path, error);
+    return;
+  }
+
+  ++writes;
+}
+
+auto
+loki::MPQDiskCache::get_stats() const -> DiskCacheStats
+{
+  DiskCacheStats stats;
+  stats.hits = hits;
+  stats.misses = misses;
+  stats.writes = writes;
+  return stats;
+}
+
+auto
+loki::MPQDiskCache::get_entry_path(StringId path) const -> std::filesystem::path
+{
+  auto digest = crypto::SHA1::get_digest_of(fingerprint, path.to_string());
+  auto name = to_hex(digest);
+
+  // Spread the entries over subdirectories, some file systems don't like huge flat directories
+  return root_dir / name.substr(0, 2) / name;
+}
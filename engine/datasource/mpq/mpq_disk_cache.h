@@ -0,0 +1,67 @@
+/*
+ * This file is part of the Loki Project.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <filesystem>
+#include <string>
+
+#include "engine/datasource/file_buffer.h"
+#include "engine/utils/string_manager.h"
+
+namespace loki {
+
+  struct DiskCacheStats
+  {
+    std::size_t hits{ 0 };
+    std::size_t misses{ 0 };
+    std::size_t writes{ 0 };
+  };
+
+  // Decompressed files persisted between launches, a warm start maps them instead of going through StormLib.
+  // Entries are keyed by the file path and the fingerprint of the archive chain, so patching the data dir invalidates them all
+  class MPQDiskCache
+  {
+  public:
+    explicit MPQDiskCache() = default;
+
+  public:
+    void open(const std::filesystem::path& cache_dir, const std::string& chain_fingerprint);
+
+    auto is_enabled() const -> bool
+    {
+      return !root_dir.empty();
+    }
+
+    auto find(StringId path) -> FileBuffer;
+    void store(StringId path, const FileBuffer& buffer);
+
+    auto get_stats() const -> DiskCacheStats;
+
+  private:
+    auto get_entry_path(StringId path) const -> std::filesystem::path;
+
+  private:
+    std::filesystem::path root_dir{};
+    std::string fingerprint{};
+    std::atomic_size_t hits{ 0 };
+    std::atomic_size_t misses{ 0 };
+    std::atomic_size_t writes{ 0 };
+  };
+
+} // namespace loki
@@ -18,6 +18,8 @@
 #include "mpq_file.h"
 #include "libassert/assert.hpp"
 
+#include <algorithm>
+
 auto
 loki::MPQFile::is_valid() const -> bool
 {
@@ -69,3 +71,29 @@ loki::MPQFile::read_all(std::vector<char>& buffer) const -> unsigned long
   buffer.resize(size);
   return read(buffer.data(), size);
 }
+
+auto
+loki::MPQFile::read_range(unsigned long offset, void* data, unsigned long size) const -> unsigned long
+{
+  auto file_size = get_size();
+  if (offset >= file_size) {
+    return 0;
+  }
+
+  seek(static_cast<long>(offset), FILE_BEGIN);
+  return read(data, std::min(size, file_size - offset));
+}
+
+auto
+loki::MPQFile::read_range(unsigned long offset, unsigned long size) const -> std::vector<char>
+{
+  // Clamped before allocating, a request for the rest of the file may pass any size
+  auto file_size = get_size();
+  if (offset >= file_size) {
+    return {};
+  }
+
+  std::vector<char> data(std::min(size, file_size - offset));
+  data.resize(read_range(offset, data.data(), static_cast<unsigned long>(data.size())));
+  return data;
+}
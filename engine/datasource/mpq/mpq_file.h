@@ -40,6 +40,10 @@ namespace loki {
     auto read(unsigned long size) const -> std::vector<char>;
     auto read_all(std::vector<char>& buffer) const -> unsigned long;
 
+    // Only the sectors covering the range are decompressed
+    auto read_range(unsigned long offset, void* data, unsigned long size) const -> unsigned long;
+    auto read_range(unsigned long offset, unsigned long size) const -> std::vector<char>;
+
     auto seek(long position, long method) const -> unsigned long;
 
   private:
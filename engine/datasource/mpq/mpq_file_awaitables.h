@@ -0,0 +1,147 @@
+/*
+ * This file is part of the Loki Project.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <coroutine>
+
+#include "mpq_file_manager.h"
+
+namespace loki {
+
+  // co_await read_file(path) resumes on the file worker that read it, or right away on a cache hit.
+  // A cancelled request resumes with an invalid buffer, so the coroutine always gets to finish
+  class FileReadAwaitable
+  {
+  public:
+    explicit FileReadAwaitable(std::filesystem::path path, FileRequestPriority priority, FileRequestToken token)
+      : path(std::move(path))
+      , priority(priority)
+      , token(std::move(token))
+    {
+    }
+
+  public:
+    auto await_ready() const noexcept -> bool
+    {
+      return false;
+    }
+
+    auto await_suspend(std::coroutine_handle<> awaiting) -> bool
+    {
+      handle = awaiting;
+
+      // The callback only captures this, small enough for std::function to keep it without an allocation
+      MPQFileManager::get_ref().request_file(
+          path,
+          [this](const FileBuffer& buffer) {
+            result = buffer;
+            complete();
+          },
+          priority, token, true);
+
+      // A cache hit calls back before request_file returns, the coroutine just goes on then
+      return !completed.exchange(true, std::memory_order_acq_rel);
+    }
+
+    auto await_resume() -> FileBuffer
+    {
+      return std::move(result);
+    }
+
+  private:
+    void complete()
+    {
+      if (completed.exchange(true, std::memory_order_acq_rel)) {
+        handle.resume();
+      }
+    }
+
+  private:
+    std::filesystem::path path;
+    FileRequestPriority priority;
+    FileRequestToken token;
+    std::coroutine_handle<> handle{};
+    std::atomic_bool completed{ false };
+    FileBuffer result{};
+  };
+
+  // Same for a batch, the buffers come in the order of the paths
+  class FileBatchReadAwaitable
+  {
+  public:
+    explicit FileBatchReadAwaitable(std::vector<std::filesystem::path> paths, FileBatchOrder order, FileRequestPriority priority, FileRequestToken token)
+      : paths(std::move(paths))
+      , order(order)
+      , priority(priority)
+      , token(std::move(token))
+    {
+    }
+
+  public:
+    auto await_ready() const noexcept -> bool
+    {
+      return false;
+    }
+
+    auto await_suspend(std::coroutine_handle<> awaiting) -> bool
+    {
+      handle = awaiting;
+
+      MPQFileManager::get_ref().request_files(
+          paths,
+          [this](std::vector<FileBuffer>&& buffers) {
+            results = std::move(buffers);
+            if (completed.exchange(true, std::memory_order_acq_rel)) {
+              handle.resume();
+            }
+          },
+          order, priority, token, true);
+
+      return !completed.exchange(true, std::memory_order_acq_rel);
+    }
+
+    auto await_resume() -> std::vector<FileBuffer>
+    {
+      return std::move(results);
+    }
+
+  private:
+    std::vector<std::filesystem::path> paths;
+    FileBatchOrder order;
+    FileRequestPriority priority;
+    FileRequestToken token;
+    std::coroutine_handle<> handle{};
+    std::atomic_bool completed{ false };
+    std::vector<FileBuffer> results{};
+  };
+
+  inline auto
+  read_file(std::filesystem::path path, FileRequestPriority priority = FileRequestPriority::NORMAL, FileRequestToken token = {}) -> FileReadAwaitable
+  {
+    return FileReadAwaitable(std::move(path), priority, std::move(token));
+  }
+
+  inline auto
+  read_files(std::vector<std::filesystem::path> paths, FileBatchOrder order = FileBatchOrder::AS_GIVEN, FileRequestPriority priority = FileRequestPriority::NORMAL,
+      FileRequestToken token = {}) -> FileBatchReadAwaitable
+  {
+    return FileBatchReadAwaitable(std::move(paths), order, priority, std::move(token));
+  }
+
+} // namespace loki
@@ -0,0 +1,249 @@
+/*
+ * This file is part of the Loki Project.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "mpq_file_cache.h"
+
+#include "lz4.h"
+#include "spdlog/spdlog.h"
+
+void
+loki::MPQFileCache::set_budget(std::size_t bytes)
+{
+  std::vector<Entry> evicted;
+
+  {
+    std::lock_guard lock(mutex);
+    budget = bytes;
+    evicted = evict_to_budget();
+  }
+
+  store_compressed(std::move(evicted));
+}
+
+void
+loki::MPQFileCache::set_compressed_budget(std::size_t bytes)
+{
+  std::lock_guard lock(mutex);
+  compressed_budget = bytes;
+  evict_compressed_to_budget();
+}
+
+auto
+loki::MPQFileCache::find(StringId path) -> FileBuffer
+{
+  std::lock_guard lock(mutex);
+
+  auto it = lookup.find(path);
+  if (it == lookup.end()) {
+    return FileBuffer();
+  }
+
+  ++hits;
+  entries.splice(entries.begin(), entries, it->second);
+  return it->second->buffer;
+}
+
+auto
+loki::MPQFileCache::find_compressed(StringId path) -> FileBuffer
+{
+  CompressedEntry compressed_entry{ path, {}, 0 };
+
+  {
+    std::lock_guard lock(mutex);
+
+    auto compressed_it = compressed_lookup.find(path);
+    if (compressed_it == compressed_lookup.end()) {
+      ++misses;
+      return FileBuffer();
+    }
+
+    // Taken out of the compressed tier, the file goes back to the first one
+    compressed_entry = std::move(*compressed_it->second);
+    compressed_size -= compressed_entry.data.size();
+    compressed_raw_size -= compressed_entry.size;
+    compressed_entries.erase(compressed_it->second);
+    compressed_lookup.erase(compressed_it);
+  }
+
+  std::vector<char> data(compressed_entry.size);
+  int size = LZ4_decompress_safe(compressed_entry.data.data(), data.data(), static_cast<int>(compressed_entry.data.size()), static_cast<int>(data.size()));
+  bool decompressed = size == static_cast<int>(data.size());
+
+  {
+    std::lock_guard lock(mutex);
+    ++(decompressed ? compressed_hits : misses);
+  }
+
+  // A corrupt entry is of no use anymore, the caller reads the file again
+  if (!decompressed) {
+    spdlog::error("Failed to decompress cached file '{}'", path.to_string());
+    return FileBuffer();
+  }
+
+  FileBuffer buffer(std::move(data));
+  insert(path, buffer);
+
+  return buffer;
+}
+
+void
+loki::MPQFileCache::insert(StringId path, const FileBuffer& buffer)
+{
+  if (!buffer.is_valid()) {
+    return;
+  }
+
+  std::vector<Entry> evicted;
+
+  {
+    std::lock_guard lock(mutex);
+
+    // A file bigger than the whole budget would just flush everything else out
+    if (buffer.size() > budget) {
+      return;
+    }
+
+    auto it = lookup.find(path);
+    if (it != lookup.end()) {
+      size -= it->second->buffer.size();
+      entries.erase(it->second);
+      lookup.erase(it);
+    }
+
+    entries.push_front(Entry{ path, buffer });
+    lookup.emplace(path, entries.begin());
+    size += buffer.size();
+
+    evicted = evict_to_budget();
+  }
+
+  // Compressed without the lock, lookups of other files don't have to wait for it
+  store_compressed(std::move(evicted));
+}
+
+void
+loki::MPQFileCache::clear()
+{
+  std::lock_guard lock(mutex);
+  entries.clear();
+  lookup.clear();
+  size = 0;
+  compressed_entries.clear();
+  compressed_lookup.clear();
+  compressed_size = 0;
+  compressed_raw_size = 0;
+}
+
+auto
+loki::MPQFileCache::get_stats() const -> FileCacheStats
+{
+  std::lock_guard lock(mutex);
+
+  FileCacheStats stats;
+  stats.hits = hits;
+  stats.misses = misses;
+  stats.evictions = evictions;
+  stats.num_entries = entries.size();
+  stats.size = size;
+  stats.budget = budget;
+  stats.compressed_hits = compressed_hits;
+  stats.compressed_evictions = compressed_evictions;
+  stats.compressed_num_entries = compressed_entries.size();
+  stats.compressed_size = compressed_size;
+  stats.compressed_raw_size = compressed_raw_size;
+  stats.compressed_budget = compressed_budget;
+
+  return stats;
+}
+
+auto
+loki::MPQFileCache::evict_to_budget() -> std::vector<Entry>
+{
+  std::vector<Entry> evicted;
+
+  while (size > budget && !entries.empty()) {
+    auto& entry = entries.back();
+    size -= entry.buffer.size();
+    lookup.erase(entry.path);
+    evicted.push_back(std::move(entry));
+    entries.pop_back();
+    ++evictions;
+  }
+
+  return evicted;
+}
+
+void
+loki::MPQFileCache::evict_compressed_to_budget()
+{
+  while (compressed_size > compressed_budget && !compressed_entries.empty()) {
+    auto& entry = compressed_entries.back();
+    compressed_size -= entry.data.size();
+    compressed_raw_size -= entry.size;
+    compressed_lookup.erase(entry.path);
+    compressed_entries.pop_back();
+    ++compressed_evictions;
+  }
+}
+
+void
+loki::MPQFileCache::store_compressed(std::vector<Entry>&& evicted)
+{
+  std::size_t current_budget;
+
+  {
+    std::lock_guard lock(mutex);
+    current_budget = compressed_budget;
+  }
+
+  if (current_budget == 0) {
+    return;
+  }
+
+  for (auto& entry : evicted) {
+    if (entry.buffer.size() == 0 || entry.buffer.size() > LZ4_MAX_INPUT_SIZE) {
+      continue;
+    }
+
+    auto source_size = static_cast<int>(entry.buffer.size());
+    std::vector<char> data(LZ4_compressBound(source_size));
+    int compressed = LZ4_compress_default(entry.buffer.data(), data.data(), source_size, static_cast<int>(data.size()));
+
+    // Already compressed payloads barely shrink, keeping them would cost nearly as much as the first tier
+    if (compressed <= 0 || static_cast<std::size_t>(compressed) > entry.buffer.size() - entry.buffer.size() / 8 ||
+        static_cast<std::size_t>(compressed) > current_budget) {
+      continue;
+    }
+
+    data.resize(compressed);
+    data.shrink_to_fit();
+
+    std::lock_guard lock(mutex);
+
+    // The file may have been read again and cached meanwhile
+    if (lookup.contains(entry.path) || compressed_lookup.contains(entry.path)) {
+      continue;
+    }
+
+    compressed_size += data.size();
+    compressed_raw_size += entry.buffer.size();
+    compressed_entries.push_front(CompressedEntry{ entry.path, std::move(data), entry.buffer.size() });
+    compressed_lookup.emplace(entry.path, compressed_entries.begin());
+
+    evict_compressed_to_budget();
+  }
+}
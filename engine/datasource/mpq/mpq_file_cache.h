@@ -0,0 +1,106 @@
+/*
+ * This file is part of the Loki Project.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <list>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "engine/datasource/file_buffer.h"
+#include "engine/utils/string_manager.h"
+
+namespace loki {
+
+  struct FileCacheStats
+  {
+    std::size_t hits{ 0 };
+    std::size_t misses{ 0 };
+    std::size_t evictions{ 0 };
+    std::size_t num_entries{ 0 };
+    std::size_t size{ 0 };
+    std::size_t budget{ 0 };
+    std::size_t compressed_hits{ 0 };
+    std::size_t compressed_evictions{ 0 };
+    std::size_t compressed_num_entries{ 0 };
+    std::size_t compressed_size{ 0 };     // bytes held by the compressed tier
+    std::size_t compressed_raw_size{ 0 }; // what those files take decompressed
+    std::size_t compressed_budget{ 0 };
+  };
+
+  // Decompressed file contents bounded by a byte budget, the least recently used files are evicted first.
+  // Evicted files drop to a second tier that keeps them LZ4 compressed under its own budget, which is much cheaper
+  // to decompress on a hit than another read from the archives
+  class MPQFileCache
+  {
+    struct Entry
+    {
+      StringId path;
+      FileBuffer buffer;
+    };
+
+    struct CompressedEntry
+    {
+      StringId path;
+      std::vector<char> data;
+      std::size_t size; // decompressed
+    };
+
+  public:
+    explicit MPQFileCache(std::size_t budget = 0)
+      : budget(budget)
+    {
+    }
+
+  public:
+    void set_budget(std::size_t bytes);
+    void set_compressed_budget(std::size_t bytes); // 0 disables the compressed tier
+
+    // Only looks at the first tier, cheap enough for any thread
+    auto find(StringId path) -> FileBuffer;
+    // Decompresses a file from the second tier back into the first one, meant for file workers
+    auto find_compressed(StringId path) -> FileBuffer;
+    void insert(StringId path, const FileBuffer& buffer);
+    void clear();
+
+    auto get_stats() const -> FileCacheStats;
+
+  private:
+    auto evict_to_budget() -> std::vector<Entry>;
+    void evict_compressed_to_budget();
+    void store_compressed(std::vector<Entry>&& evicted);
+
+  private:
+    mutable std::mutex mutex;
+    std::size_t budget;
+    std::size_t size{ 0 };
+    std::size_t hits{ 0 };
+    std::size_t misses{ 0 };
+    std::size_t evictions{ 0 };
+    std::list<Entry> entries; // the most recently used file goes first
+    std::unordered_map<StringId, std::list<Entry>::iterator> lookup;
+    std::size_t compressed_budget{ 0 };
+    std::size_t compressed_size{ 0 };
+    std::size_t compressed_raw_size{ 0 };
+    std::size_t compressed_hits{ 0 };
+    std::size_t compressed_evictions{ 0 };
+    std::list<CompressedEntry> compressed_entries;
+    std::unordered_map<StringId, std::list<CompressedEntry>::iterator> compressed_lookup;
+  };
+
+} // namespace loki
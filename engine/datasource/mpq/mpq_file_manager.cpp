@@ -16,62 +16,409 @@
  */
 
 #include "mpq_file_manager.h"
+#include "mpq_sector_reader.h"
 #include "libassert/assert.hpp"
 
+#include <algorithm>
+
 void
-loki::MPQFileManager::init(const std::filesystem::path& data_dir)
+loki::MPQFileManager::init(const std::filesystem::path& data_dir, std::size_t num_workers, const std::filesystem::path& cache_dir)
 {
-  enqueue_request([this, data_dir]() {
-    chain = MPQChain(data_dir);
-  });
+  DEBUG_ASSERT(workers.empty(), "MPQFileManager is already initialized");
+
+  archive_paths = MPQChain::find_archives(data_dir);
+  auto fingerprint = MPQChain::get_fingerprint(archive_paths);
+
+  if (!cache_dir.empty()) {
+    disk_cache.open(cache_dir, fingerprint);
+  }
+
+  // Saved next to the data dir, e.g. "Data.index"
+  auto index_path = data_dir;
+  index_path += ".index";
+  load_index(index_path, fingerprint);
+
+  if (!cooked_pack_path.empty()) {
+    cooked_pack.open(cooked_pack_path, fingerprint);
+  }
+
+  if (map_archives) {
+    for (const auto& archive_path : archive_paths) {
+      auto mapping = std::make_shared<MappedFile>(archive_path);
+      archive_mappings.push_back(mapping->is_valid() ? mapping : nullptr);
+    }
+  }
+
+  num_workers = std::max<std::size_t>(num_workers, 1);
+
+  {
+    std::lock_guard lock(requests_mutex);
+    running = true;
+  }
+
+  for (std::size_t i = 0; i < num_workers; ++i) {
+    workers.emplace_back(&MPQFileManager::run, this);
+  }
+
+  spdlog::info("MPQ file manager started {} worker(s)", num_workers);
 }
 
 void
 loki::MPQFileManager::term()
 {
   stop();
-  thread.join();
+
+  for (auto& worker : workers) {
+    worker.join();
+  }
+
+  workers.clear();
+  archive_mappings.clear();
+  cooked_pack = CookedPack();
+
+  if (index_thread.joinable()) {
+    index_thread.join();
+  }
+
+  if (prefetch_manifest.is_recording()) {
+    prefetch_manifest.save(prefetch_manifest_path);
+  }
 }
 
 void
-loki::MPQFileManager::request_file(const std::filesystem::path& path, const FileCallback& callback)
+loki::MPQFileManager::enable_prefetch_manifest(const std::filesystem::path& manifest_path)
 {
-  enqueue_request([this, path, callback]() {
-    HANDLE handle{};
+  auto entries = MPQPrefetchManifest::load(manifest_path);
+  spdlog::info("Prefetching {} files from '{}'", entries.size(), manifest_path.string());
 
-    auto archive_handle = chain.get_archive().get_handle();
-    if (!archive_handle) {
-      spdlog::error("Cannot open file: {}, skipping...", path.string());
-      return;
-    }
+  // Requests of the same priority are served in order, so the files arrive in the order they were needed last time
+  for (const auto& entry : entries) {
+    request_file(entry.path, [](const FileBuffer&) {}, FileRequestPriority::PREFETCH);
+  }
+
+  prefetch_manifest_path = manifest_path;
+  prefetch_manifest.start_recording();
+}
+
+auto
+loki::MPQFileManager::get_default_num_workers() -> std::size_t
+{
+  // The job workers already take one thread per core, file workers mostly wait on the disk but StormLib still
+  // decompresses small files on them. Half the cores keep a few reads in flight without crowding the job system
+  auto num_cores = static_cast<std::size_t>(std::thread::hardware_concurrency());
+  return std::clamp<std::size_t>(num_cores / 2, 2, 4);
+}
+
+auto
+loki::MPQFileManager::get_index() const -> std::shared_ptr<const MPQIndex>
+{
+  std::lock_guard lock(index_mutex);
+  return index;
+}
+
+auto
+loki::MPQFileManager::find_files(std::string_view pattern) const -> std::vector<std::string>
+{
+  auto current_index = get_index();
+  if (!current_index) {
+    return {};
+  }
+
+  auto paths = current_index->find_files(pattern);
+  return { paths.begin(), paths.end() };
+}
+
+void
+loki::MPQFileManager::request_file(
+    const std::filesystem::path& path, const FileCallback& callback, FileRequestPriority priority, const FileRequestToken& token, bool notify_cancelled)
+{
+  auto path_id = get_path_id(path);
+
+  if (priority != FileRequestPriority::PREFETCH) {
+    prefetch_manifest.record(path_id);
+  }
+
+  Waiter waiter;
+  waiter.callback = callback;
+  waiter.cancellable = is_token_set(token);
+  waiter.notify_cancelled = notify_cancelled;
+  waiter.token = token;
+
+  add_waiter(path_id, std::move(waiter), priority);
+}
+
+void
+loki::MPQFileManager::request_files(const std::vector<std::filesystem::path>& paths, const BatchCallback& callback, FileBatchOrder order,
+    FileRequestPriority priority, const FileRequestToken& token, bool notify_cancelled)
+{
+  struct Batch
+  {
+    BatchCallback callback;
+    std::vector<FileBuffer> buffers;
+    std::atomic_size_t remaining;
+  };
+
+  if (paths.empty()) {
+    callback({});
+    return;
+  }
 
-    if (SFileOpenFileEx(archive_handle, path.string().c_str(), SFILE_OPEN_FROM_MPQ, &handle)) {
-      char filename[MAX_PATH];
-      if (SFileGetFileName(handle, filename)) {
-        spdlog::info("Open file: '{}'", filename);
+  auto batch = std::make_shared<Batch>();
+  batch->callback = callback;
+  batch->buffers.resize(paths.size());
+  batch->remaining = paths.size();
+
+  // Buffers held by an incomplete batch aren't counted as in flight, otherwise a stall could wait for the batch
+  // while the batch waits for a stalled read
+  auto make_callback = [this, batch](std::size_t i) {
+    return [this, batch, i](const FileBuffer& buffer) {
+      batch->buffers[i] = buffer;
+      if (--batch->remaining == 0) {
+        for (auto& batch_buffer : batch->buffers) {
+          batch_buffer = track_in_flight(batch_buffer);
+        }
+
+        batch->callback(std::move(batch->buffers));
+      }
+    };
+  };
+
+  if (order == FileBatchOrder::AS_GIVEN) {
+    for (std::size_t i = 0; i < paths.size(); ++i) {
+      auto path_id = get_path_id(paths[i]);
+      if (priority != FileRequestPriority::PREFETCH) {
+        prefetch_manifest.record(path_id);
       }
 
-      loki::MPQFile file(filename, handle);
-      callback(file);
+      Waiter waiter;
+      waiter.callback = make_callback(i);
+      waiter.cancellable = is_token_set(token);
+      waiter.tracked = false;
+      waiter.notify_cancelled = notify_cancelled;
+      waiter.token = token;
+
+      add_waiter(path_id, std::move(waiter), priority);
+    }
+    return;
+  }
+
+  // Files nobody is reading yet are claimed by one job that reads them sequentially, others still can attach to them
+  std::vector<StringId> claimed_paths;
+  std::vector<std::pair<FileCallback, FileBuffer>> cached;
+
+  std::vector<std::pair<std::size_t, StringId>> missed;
+
+  // The cache is looked up before taking the requests lock, it has its own
+  for (std::size_t i = 0; i < paths.size(); ++i) {
+    auto path_id = get_path_id(paths[i]);
+    if (priority != FileRequestPriority::PREFETCH) {
+      prefetch_manifest.record(path_id);
+    }
 
-      bool result = SFileCloseFile(handle);
-      ASSERT(result, "Can't close the file");
+    if (auto buffer = cache.find(path_id); buffer.is_valid()) {
+      cached.emplace_back(make_callback(i), buffer);
     } else {
-      spdlog::error("Failed to open: {}", path.string().c_str());
+      missed.emplace_back(i, path_id);
     }
+  }
+
+  {
+    std::lock_guard lock(requests_mutex);
+
+    for (auto [i, path_id] : missed) {
+      Waiter waiter;
+      waiter.callback = make_callback(i);
+      waiter.cancellable = is_token_set(token);
+      waiter.tracked = false;
+      waiter.notify_cancelled = notify_cancelled;
+      waiter.token = token;
+
+      auto [it, inserted] = pending_files.try_emplace(path_id);
+      it->second.waiters.push_back(std::move(waiter));
+
+      if (inserted) {
+        it->second.priority = priority;
+        it->second.reading = true;
+        claimed_paths.push_back(path_id);
+      } else {
+        ++num_coalesced;
+        raise_priority(path_id, priority);
+      }
+    }
+  }
+
+  for (auto& [file_callback, buffer] : cached) {
+    file_callback(buffer);
+  }
+
+  if (claimed_paths.empty()) {
+    return;
+  }
+
+  // The job has no token on purpose: it owns the claimed files and must complete every one of them
+  enqueue_job(claimed_paths.front(), priority, {}, [this, claimed_paths = std::move(claimed_paths)](WorkerContext& context) mutable {
+    if (auto current_index = get_index()) {
+      auto get_position = [&current_index](StringId path) {
+        const auto* entry = current_index->find(path.to_string());
+        return entry ? std::make_pair(entry->archive, entry->block) : std::make_pair(~0u, ~0u);
+      };
+
+      std::stable_sort(claimed_paths.begin(), claimed_paths.end(), [&get_position](StringId a, StringId b) {
+        return get_position(a) < get_position(b);
+      });
+    }
+
+    for (auto path : claimed_paths) {
+      bool cancelled = false;
+      std::vector<Waiter> waiters_to_notify;
+
+      {
+        std::lock_guard lock(requests_mutex);
+        auto it = pending_files.find(path);
+        cancelled = it == pending_files.end() || it->second.is_cancelled();
+        if (cancelled && it != pending_files.end()) {
+          drop_pending_file(it);
+          waiters_to_notify.swap(cancelled_waiters);
+        }
+      }
+
+      notify_cancelled_waiters(std::move(waiters_to_notify));
+
+      if (!cancelled) {
+        complete_request(path, load_file(context, path));
+      }
+    }
+  });
+}
+
+void
+loki::MPQFileManager::request_file_range(const std::filesystem::path& path, unsigned long offset, unsigned long size, const FileCallback& callback,
+    FileRequestPriority priority, const FileRequestToken& token)
+{
+  auto path_id = get_path_id(path);
+
+  if (priority != FileRequestPriority::PREFETCH) {
+    prefetch_manifest.record(path_id);
+  }
+
+  if (auto buffer = cache.find(path_id); buffer.is_valid()) {
+    callback(track_in_flight(buffer.slice(offset, size)));
+    return;
+  }
+
+  enqueue_job(path_id, priority, token, [this, path_id, offset, size, callback](WorkerContext& context) {
+    HANDLE handle = open_file(context, path_id).handle;
+    if (!handle) {
+      callback(FileBuffer());
+      return;
+    }
+
+    MPQFile file(path_id.to_string(), handle);
+    auto data = file.read_range(offset, size);
+    SFileCloseFile(handle);
+
+    callback(track_in_flight(FileBuffer(std::move(data))));
   });
 }
 
+void
+loki::MPQFileManager::request_file_stream(const std::filesystem::path& path, unsigned long chunk_size, const StreamCallback& callback,
+    FileRequestPriority priority, const FileRequestToken& token)
+{
+  auto path_id = get_path_id(path);
+
+  enqueue_job(path_id, priority, token, [this, path_id, chunk_size, callback](WorkerContext& context) {
+    HANDLE handle = open_file(context, path_id).handle;
+
+    MPQFile file(path_id.to_string(), handle);
+    MPQFileStream stream(file, chunk_size);
+    callback(stream);
+
+    if (handle) {
+      SFileCloseFile(handle);
+    }
+  });
+}
+
+void
+loki::MPQFileManager::update_priority(const std::filesystem::path& path, FileRequestPriority priority)
+{
+  std::lock_guard lock(requests_mutex);
+
+  // Unlike a coalesced request, the owner may lower it too, e.g. for an asset that went out of sight
+  auto path_id = get_path_id(path);
+  auto it = pending_files.find(path_id);
+  if (it != pending_files.end() && !it->second.reading && it->second.priority != priority) {
+    set_pending_priority(path_id, it->second, priority);
+  }
+}
+
+void
+loki::MPQFileManager::enqueue_job(StringId path, FileRequestPriority priority, const FileRequestToken& token, Job&& job)
+{
+  Request request;
+  request.path = path;
+  request.priority = priority;
+  request.job = std::move(job);
+  request.cancellable = is_token_set(token);
+  request.token = token;
+
+  std::lock_guard lock(requests_mutex);
+  request.sequence = next_sequence++;
+
+  requests.push_back(std::move(request));
+  std::push_heap(requests.begin(), requests.end(), &MPQFileManager::compare_requests);
+  cv.notify_one();
+}
+
+void
+loki::MPQFileManager::raise_priority(StringId path, FileRequestPriority priority)
+{
+  auto it = pending_files.find(path);
+  if (it == pending_files.end() || it->second.reading || it->second.priority >= priority) {
+    return;
+  }
+
+  set_pending_priority(path, it->second, priority);
+}
+
+void
+loki::MPQFileManager::set_pending_priority(StringId path, PendingFile& pending_file, FileRequestPriority priority)
+{
+  pending_file.priority = priority;
+
+  for (auto& request : requests) {
+    if (request.path == path && !request.job) {
+      request.priority = priority;
+    }
+  }
+
+  std::make_heap(requests.begin(), requests.end(), &MPQFileManager::compare_requests);
+
+  // A raised request may get past a stall now
+  cv.notify_one();
+}
+
 void
 loki::MPQFileManager::run()
 {
+  // Worker-local handles, so reads and decompression of different files can run in parallel.
+  // They're opened on the first miss of the disk cache, a fully warm start never touches StormLib
+  WorkerContext context{ archive_paths };
+  context.raw_reader = MPQRawReader::create(raw_backend);
+
   do {
-    RequestCallback request;
+    std::optional<Request> request;
+    std::vector<Waiter> waiters_to_notify;
 
     {
       std::unique_lock lock(requests_mutex);
+      if (!requests.empty() && is_stalled(requests.front().priority)) {
+        ++num_stalls;
+      }
+
       cv.wait(lock, [this] {
-        return !requests.empty() || !running;
+        return (!requests.empty() && !is_stalled(requests.front().priority)) || !running;
       });
 
       if (!running) {
@@ -79,13 +426,46 @@ loki::MPQFileManager::run()
       }
 
       request = pop_next_request();
+      waiters_to_notify.swap(cancelled_waiters);
     }
 
-    if (request) {
-      spdlog::info("Executing task...");
-      request();
+    notify_cancelled_waiters(std::move(waiters_to_notify));
+
+    if (!request) {
+      continue;
+    }
+
+    if (request->job) {
+      request->job(context);
+      continue;
     }
+
+    complete_request(request->path, load_file(context, request->path));
   } while (true);
+
+  context.close();
+}
+
+void
+loki::MPQFileManager::load_index(const std::filesystem::path& index_path, const std::string& chain_fingerprint)
+{
+  auto loaded_index = std::make_shared<MPQIndex>();
+  if (loaded_index->load(index_path, chain_fingerprint)) {
+    std::lock_guard lock(index_mutex);
+    index = std::move(loaded_index);
+    return;
+  }
+
+  // Building takes a while, the workers go through the patch chain until it's done
+  index_thread = std::thread([this, index_path, chain_fingerprint]() {
+    auto built_index = std::make_shared<MPQIndex>(MPQIndex::build(archive_paths));
+    if (!built_index->save(index_path, chain_fingerprint)) {
+      spdlog::error("Failed to save the MPQ index '{}'", index_path.string());
+    }
+
+    std::lock_guard lock(index_mutex);
+    index = std::move(built_index);
+  });
 }
 
 void
@@ -94,30 +474,433 @@ loki::MPQFileManager::stop()
   std::lock_guard lock(requests_mutex);
 
   running = false;
-  while (!requests.empty()) {
-    requests.pop();
-  }
+  requests.clear();
+  pending_files.clear();
 
   cv.notify_all();
 }
 
 void
-loki::MPQFileManager::enqueue_request(loki::MPQFileManager::RequestCallback&& callback)
+loki::MPQFileManager::enqueue_request(StringId path, FileRequestPriority priority)
 {
-  std::lock_guard lock(requests_mutex);
-  requests.emplace(callback);
+  Request request;
+  request.path = path;
+  request.priority = priority;
+  request.sequence = next_sequence++;
+
+  requests.push_back(std::move(request));
+  std::push_heap(requests.begin(), requests.end(), &MPQFileManager::compare_requests);
   cv.notify_one();
 }
 
-loki::MPQFileManager::RequestCallback
-loki::MPQFileManager::pop_next_request()
+void
+loki::MPQFileManager::complete_request(StringId path, const FileBuffer& buffer)
 {
-  if (requests.empty()) {
-    return {};
+  // A view into a mapped archive costs no memory, caching it would only push real entries out
+  if (!is_mapped(buffer)) {
+    cache.insert(path, buffer);
+  }
+
+  std::vector<Waiter> waiters;
+
+  {
+    std::lock_guard lock(requests_mutex);
+
+    // Everybody who attached while the file was being read gets the same buffer
+    auto it = pending_files.find(path);
+    if (it == pending_files.end()) {
+      return;
+    }
+
+    waiters = std::move(it->second.waiters);
+    pending_files.erase(it);
+  }
+
+  // One ticket for everybody, the bytes are released when the last of them drops the buffer
+  FileBuffer tracked_buffer;
+
+  for (const auto& waiter : waiters) {
+    if (waiter.is_cancelled()) {
+      if (waiter.notify_cancelled) {
+        waiter.callback(FileBuffer());
+      }
+      continue;
+    }
+
+    if (!waiter.tracked) {
+      waiter.callback(buffer);
+      continue;
+    }
+
+    if (!tracked_buffer.is_valid()) {
+      tracked_buffer = track_in_flight(buffer);
+    }
+
+    waiter.callback(tracked_buffer);
+  }
+}
+
+void
+loki::MPQFileManager::add_waiter(StringId path, Waiter&& waiter, FileRequestPriority priority)
+{
+  // First tier hits don't need a worker at all, compressed ones are decompressed by the worker in load_file
+  if (auto buffer = cache.find(path); buffer.is_valid()) {
+    waiter.callback(waiter.tracked ? track_in_flight(buffer) : buffer);
+    return;
+  }
+
+  std::lock_guard lock(requests_mutex);
+
+  auto [it, inserted] = pending_files.try_emplace(path);
+  auto& pending_file = it->second;
+  pending_file.waiters.push_back(std::move(waiter));
+
+  if (inserted) {
+    pending_file.priority = priority;
+    enqueue_request(path, priority);
+    return;
+  }
+
+  ++num_coalesced;
+  spdlog::debug("Request for '{}' is attached to the one in flight", path.to_string());
+
+  raise_priority(path, priority);
+}
+
+void
+loki::MPQFileManager::drop_pending_file(std::unordered_map<StringId, PendingFile>::iterator it)
+{
+  for (auto& waiter : it->second.waiters) {
+    if (waiter.notify_cancelled) {
+      cancelled_waiters.push_back(std::move(waiter));
+    }
+  }
+
+  pending_files.erase(it);
+}
+
+void
+loki::MPQFileManager::notify_cancelled_waiters(std::vector<Waiter>&& waiters)
+{
+  for (const auto& waiter : waiters) {
+    waiter.callback(FileBuffer());
+  }
+}
+
+auto
+loki::MPQFileManager::track_in_flight(const FileBuffer& buffer) -> FileBuffer
+{
+  // Mapped files live in the page cache, they don't grow the heap however long they wait
+  if (!buffer.is_valid() || buffer.size() == 0 || is_mapped(buffer)) {
+    return buffer;
+  }
+
+  struct Ticket
+  {
+    Ticket(const FileBuffer& buffer, MPQFileManager* file_manager)
+      : buffer(buffer)
+      , file_manager(file_manager)
+    {
+    }
+
+    Ticket(const Ticket&) = delete;
+    Ticket& operator=(const Ticket&) = delete;
+
+    ~Ticket()
+    {
+      file_manager->release_in_flight(buffer.size());
+    }
+
+    FileBuffer buffer;
+    MPQFileManager* file_manager;
+  };
+
+  auto bytes = in_flight_bytes += buffer.size();
+
+  auto peak = peak_in_flight_bytes.load();
+  while (bytes > peak && !peak_in_flight_bytes.compare_exchange_weak(peak, bytes)) {
+  }
+
+  auto ticket = std::make_shared<Ticket>(buffer, this);
+  return FileBuffer(ticket, buffer.get_span());
+}
+
+void
+loki::MPQFileManager::release_in_flight(std::size_t size)
+{
+  auto before = in_flight_bytes.fetch_sub(size);
+
+  // Wake up the stalled workers once the figure drops below the ceiling. The lock makes sure none of them is
+  // between checking the figure and going to sleep, so the notification can't get lost
+  if (in_flight_ceiling && before > in_flight_ceiling && before - size <= in_flight_ceiling) {
+    {
+      std::lock_guard lock(requests_mutex);
+    }
+
+    cv.notify_all();
   }
+}
 
-  auto request = std::move(requests.front());
-  requests.pop();
+auto
+loki::MPQFileManager::is_stalled(FileRequestPriority priority) const -> bool
+{
+  return in_flight_ceiling && in_flight_bytes > in_flight_ceiling && priority < FileRequestPriority::HIGH;
+}
+
+auto
+loki::MPQFileManager::get_path_id(const std::filesystem::path& path) -> StringId
+{
+  // Paths in MPQ are case-insensitive, so the same file must get the same id no matter how it's spelled
+  return StringId(MPQIndex::normalize_path(path.string()));
+}
+
+auto
+loki::MPQFileManager::is_token_set(const FileRequestToken& token) -> bool
+{
+  // An empty weak pointer is expired as well, so tell it apart from a token whose owner is gone
+  return token.owner_before(FileRequestToken{}) || FileRequestToken{}.owner_before(token);
+}
+
+auto
+loki::MPQFileManager::open_file(WorkerContext& context, StringId path) const -> OpenedFile
+{
+  const auto& path_string = path.to_string();
+  OpenedFile file;
+
+  // The index points straight to the archive that wins the file, the patch chain is only needed for unknown files and incremental patches
+  if (auto current_index = get_index()) {
+    if (const auto* entry = current_index->find(path_string); entry && !entry->requires_chain()) {
+      file.archive = context.get_archive(entry->archive).get_handle();
+      if (file.archive) {
+        file.archive_index = entry->archive;
+      }
+    }
+  }
+
+  if (!file.archive) {
+    file.archive = context.get_chain().get_archive().get_handle();
+  }
+
+  if (!file.archive) {
+    spdlog::error("Cannot open file: {}, skipping...", path_string);
+    return file;
+  }
+
+  if (!SFileOpenFileEx(file.archive, path_string.c_str(), SFILE_OPEN_FROM_MPQ, &file.handle)) {
+    spdlog::error("Failed to open: {}", path_string);
+    file.handle = HANDLE{};
+  }
+
+  return file;
+}
+
+auto
+loki::MPQFileManager::load_file(WorkerContext& context, StringId path) -> FileBuffer
+{
+  if (auto buffer = cache.find_compressed(path); buffer.is_valid()) {
+    return buffer;
+  }
 
-  return request;
+  if (auto buffer = cooked_pack.find(path.to_string()); buffer.is_valid()) {
+    return buffer;
+  }
+
+  if (auto buffer = map_file(context, path); buffer.is_valid()) {
+    return buffer;
+  }
+
+  auto buffer = disk_cache.find(path);
+  if (!buffer.is_valid()) {
+    buffer = read_file(context, path);
+    disk_cache.store(path, buffer);
+  }
+
+  return buffer;
+}
+
+auto
+loki::MPQFileManager::map_file(WorkerContext& context, StringId path) const -> FileBuffer
+{
+  if (archive_mappings.empty()) {
+    return FileBuffer();
+  }
+
+  // Only files stored as is qualify, which the index tells without opening anything
+  auto current_index = get_index();
+  const auto* entry = current_index ? current_index->find(path.to_string()) : nullptr;
+  constexpr std::uint32_t unsupported_flags = MPQ_FILE_COMPRESS_MASK | MPQ_FILE_ENCRYPTED | MPQ_FILE_PATCH_FILE | MPQ_FILE_DELETE_MARKER;
+  if (!entry || (entry->flags & unsupported_flags) || !archive_mappings[entry->archive]) {
+    return FileBuffer();
+  }
+
+  auto file = open_file(context, path);
+  if (!file.handle || file.archive_index != entry->archive) {
+    if (file.handle) {
+      SFileCloseFile(file.handle);
+    }
+
+    return FileBuffer();
+  }
+
+  DWORD file_size = 0;
+  ULONGLONG byte_offset = 0;
+  ULONGLONG header_offset = 0;
+  bool has_info = SFileGetFileInfo(file.handle, SFileInfoFileSize, &file_size, sizeof(file_size), nullptr) &&
+                  SFileGetFileInfo(file.handle, SFileInfoByteOffset, &byte_offset, sizeof(byte_offset), nullptr) &&
+                  SFileGetFileInfo(file.archive, SFileMpqHeaderOffset, &header_offset, sizeof(header_offset), nullptr);
+  SFileCloseFile(file.handle);
+
+  const auto& mapping = archive_mappings[entry->archive];
+  auto offset = header_offset + byte_offset;
+  if (!has_info || file_size == 0 || offset + file_size > mapping->size()) {
+    return FileBuffer();
+  }
+
+  return FileBuffer(mapping, mapping->get_span().subspan(offset, file_size));
+}
+
+auto
+loki::MPQFileManager::is_mapped(const FileBuffer& buffer) const -> bool
+{
+  if (cooked_pack.contains(buffer)) {
+    return true;
+  }
+
+  const char* data = buffer.data();
+  return std::any_of(archive_mappings.begin(), archive_mappings.end(), [data](const std::shared_ptr<MappedFile>& mapping) {
+    return mapping && data >= mapping->data() && data < mapping->data() + mapping->size();
+  });
+}
+
+auto
+loki::MPQFileManager::read_file(WorkerContext& context, StringId path) const -> FileBuffer
+{
+  auto file = open_file(context, path);
+  if (!file.handle) {
+    return FileBuffer();
+  }
+
+  // Sector offsets are only meaningful for a file that isn't patched, i.e. resolved by the index to a standalone archive
+  if (file.archive_index) {
+    if (auto data = MPQSectorReader::read(archive_paths[*file.archive_index], file.archive, file.handle, *context.raw_reader)) {
+      SFileCloseFile(file.handle);
+      return FileBuffer(std::move(*data));
+    }
+  }
+
+  return read_file(file.handle, path.to_string());
+}
+
+auto
+loki::MPQFileManager::read_file(HANDLE handle, const std::string& path) -> FileBuffer
+{
+  char filename[MAX_PATH];
+  if (SFileGetFileName(handle, filename)) {
+    spdlog::info("Open file: '{}'", filename);
+  }
+
+  std::vector<char> data;
+  MPQFile file(filename, handle);
+  auto bytes_read = file.read_all(data);
+
+  bool result = SFileCloseFile(handle);
+  ASSERT(result, "Can't close the file");
+
+  if (bytes_read != data.size()) {
+    spdlog::error("Failed to read: {}", path);
+    return FileBuffer();
+  }
+
+  return FileBuffer(std::move(data));
+}
+
+auto
+loki::MPQFileManager::compare_requests(const Request& a, const Request& b) -> bool
+{
+  // std heap keeps the "largest" element on top: higher priority first, FIFO within the same priority
+  if (a.priority != b.priority) {
+    return a.priority < b.priority;
+  }
+
+  return a.sequence > b.sequence;
+}
+
+auto
+loki::MPQFileManager::pop_next_request() -> std::optional<Request>
+{
+  while (!requests.empty()) {
+    // The heap top has the highest priority, if it has to wait so does everything else
+    if (is_stalled(requests.front().priority)) {
+      return std::nullopt;
+    }
+
+    std::pop_heap(requests.begin(), requests.end(), &MPQFileManager::compare_requests);
+    auto request = std::move(requests.back());
+    requests.pop_back();
+
+    // The owners could have gone while the request was waiting in the queue, drop it before any I/O
+    if (request.job) {
+      if (!request.is_cancelled()) {
+        return request;
+      }
+
+      spdlog::debug("Request for '{}' is cancelled", request.path.to_string());
+      continue;
+    }
+
+    auto it = pending_files.find(request.path);
+    if (it == pending_files.end()) {
+      continue;
+    }
+
+    if (it->second.is_cancelled()) {
+      spdlog::debug("Request for '{}' is cancelled", request.path.to_string());
+      drop_pending_file(it);
+      continue;
+    }
+
+    it->second.reading = true;
+    return request;
+  }
+
+  return std::nullopt;
+}
+
+auto
+loki::MPQFileManager::WorkerContext::get_chain() -> const MPQChain&
+{
+  if (!chain) {
+    chain.emplace(archive_paths);
+  }
+
+  return *chain;
+}
+
+auto
+loki::MPQFileManager::WorkerContext::get_archive(std::uint32_t index) -> const MPQArchive&
+{
+  DEBUG_ASSERT(index < archive_paths.size());
+
+  if (archives.empty()) {
+    archives.resize(archive_paths.size());
+  }
+
+  auto& archive = archives[index];
+  if (!archive.is_valid()) {
+    archive = MPQArchive(archive_paths[index]);
+  }
+
+  return archive;
+}
+
+void
+loki::MPQFileManager::WorkerContext::close()
+{
+  if (chain) {
+    chain->close();
+  }
+
+  for (auto& archive : archives) {
+    archive.close();
+  }
 }
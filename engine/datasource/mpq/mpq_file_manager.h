@@ -17,20 +17,124 @@
 
 #pragma once
 
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
 #include <functional>
+#include <memory>
 #include <mutex>
-#include <queue>
+#include <optional>
+#include <thread>
+#include <unordered_map>
+#include <vector>
 
+#include "engine/datasource/cooked_pack.h"
+#include "engine/datasource/file_buffer.h"
+#include "engine/utils/mapped_file.h"
 #include "engine/utils/string_manager.h"
 #include "mpq_chain.h"
+#include "mpq_disk_cache.h"
+#include "mpq_file_cache.h"
+#include "mpq_index.h"
+#include "mpq_prefetch_manifest.h"
+#include "mpq_raw_reader.h"
 #include "mpq_file.h"
+#include "mpq_file_stream.h"
 
 namespace loki {
 
+  enum class FileRequestPriority : std::uint8_t
+  {
+    PREFETCH, // nobody is waiting for it yet, only warms the cache up
+    LOW,
+    NORMAL,
+    HIGH,
+  };
+
+  enum class FileBatchOrder : std::uint8_t
+  {
+    AS_GIVEN,
+    ARCHIVE_OFFSET, // read one after another in the order they're stored on disk
+  };
+
+  // Any weak pointer works as a cancellation token, requests with an expired token are dropped before the file is opened
+  using FileRequestToken = std::weak_ptr<const void>;
+
   class MPQFileManager
   {
-    using FileCallback = std::function<void(MPQFile&)>;
-    using RequestCallback = std::function<void()>;
+    // Called on a worker thread, or right away on the calling one if the file is cached. The buffer is invalid if the file couldn't be read
+    using FileCallback = std::function<void(const FileBuffer&)>;
+    // Called on a worker thread, the stream is invalid if the file couldn't be opened
+    using StreamCallback = std::function<void(MPQFileStream&)>;
+    // Called once with a buffer per requested path in the same order, on the thread that completed the last file
+    using BatchCallback = std::function<void(std::vector<FileBuffer>&&)>;
+
+    struct Waiter
+    {
+      FileCallback callback;
+      bool cancellable{ false };
+      bool tracked{ true }; // batches hold their buffers untracked and track them once the whole batch is complete
+      bool notify_cancelled{ false };
+      FileRequestToken token;
+
+      auto is_cancelled() const -> bool
+      {
+        return cancellable && token.expired();
+      }
+    };
+
+    // All requests of the same file share one read, later requesters just attach to it
+    struct PendingFile
+    {
+      FileRequestPriority priority{ FileRequestPriority::NORMAL };
+      bool reading{ false };
+      std::vector<Waiter> waiters;
+
+      auto is_cancelled() const -> bool
+      {
+        return std::all_of(waiters.begin(), waiters.end(), [](const Waiter& waiter) {
+          return waiter.is_cancelled();
+        });
+      }
+    };
+
+    // Everything a worker opens for itself, StormLib handles are never shared between threads
+    struct WorkerContext
+    {
+      const std::vector<std::filesystem::path>& archive_paths;
+      std::optional<MPQChain> chain{};
+      std::vector<MPQArchive> archives{};
+      std::unique_ptr<MPQRawReader> raw_reader{};
+
+      auto get_chain() -> const MPQChain&;
+      auto get_archive(std::uint32_t index) -> const MPQArchive&;
+      void close();
+    };
+
+    struct OpenedFile
+    {
+      HANDLE handle{};
+      HANDLE archive{};
+      std::optional<std::uint32_t> archive_index{}; // set if the index resolved the file to a standalone archive
+    };
+
+    using Job = std::function<void(WorkerContext&)>;
+
+    // Either a whole-file read shared through pending_files, or a standalone job like a ranged or streamed read
+    struct Request
+    {
+      StringId path;
+      FileRequestPriority priority{ FileRequestPriority::NORMAL };
+      std::uint64_t sequence{ 0 };
+      Job job{};
+      bool cancellable{ false };
+      FileRequestToken token{};
+
+      auto is_cancelled() const -> bool
+      {
+        return cancellable && token.expired();
+      }
+    };
 
   public:
     static MPQFileManager& get_ref()
@@ -39,32 +143,174 @@ namespace loki {
       return file_manager;
     }
 
-    void init(const std::filesystem::path& data_dir);
+    // Every worker opens its own view of the chain, StormLib handles must not be shared between threads.
+    // An empty cache dir disables the persistent cache
+    void init(const std::filesystem::path& data_dir, std::size_t num_workers = get_default_num_workers(), const std::filesystem::path& cache_dir = {});
     void term();
 
+    // Backend for the raw reads of big files, takes effect on init
+    void set_raw_backend(MPQRawBackend backend)
+    {
+      raw_backend = backend;
+    }
+
+    // Uncompressed files are then handed out as views into the mapped archives, without a copy. Takes effect on init
+    void set_map_archives(bool enabled)
+    {
+      map_archives = enabled;
+    }
+
+    // Files of the pack are served from it before anything else is tried. Takes effect on init
+    void set_cooked_pack(const std::filesystem::path& pack_path)
+    {
+      cooked_pack_path = pack_path;
+    }
+
+    // Reads below HIGH priority stall while more than this many bytes are delivered but not yet released by
+    // their consumers, 0 means no limit
+    void set_in_flight_ceiling(std::size_t bytes)
+    {
+      in_flight_ceiling = bytes;
+    }
+
+    // Replays the manifest of the previous session as prefetch and records a new one, saved on term
+    void enable_prefetch_manifest(const std::filesystem::path& manifest_path);
+
+    // Half the cores, from 2 to 4
+    static auto get_default_num_workers() -> std::size_t;
+
+    // Tells a token that was given from the empty one, both of them are expired
+    static auto is_token_set(const FileRequestToken& token) -> bool;
+
   public:
-    void request_file(const std::filesystem::path& path, const FileCallback& callback);
+    // A cancelled request never calls back, unless notify_cancelled is set: then it calls back with an invalid buffer.
+    // Coroutines need that, they would never be resumed otherwise
+    void request_file(const std::filesystem::path& path, const FileCallback& callback, FileRequestPriority priority = FileRequestPriority::NORMAL,
+        const FileRequestToken& token = {}, bool notify_cancelled = false);
+
+    // A file of the batch that can't be read gets an invalid buffer, the batch is still completed
+    void request_files(const std::vector<std::filesystem::path>& paths, const BatchCallback& callback, FileBatchOrder order = FileBatchOrder::AS_GIVEN,
+        FileRequestPriority priority = FileRequestPriority::NORMAL, const FileRequestToken& token = {}, bool notify_cancelled = false);
+
+    // Reads a part of the file, the rest of it isn't decompressed. Served from the cache if the whole file is there
+    void request_file_range(const std::filesystem::path& path, unsigned long offset, unsigned long size, const FileCallback& callback,
+        FileRequestPriority priority = FileRequestPriority::NORMAL, const FileRequestToken& token = {});
+
+    void request_file_stream(const std::filesystem::path& path, unsigned long chunk_size, const StreamCallback& callback,
+        FileRequestPriority priority = FileRequestPriority::NORMAL, const FileRequestToken& token = {});
+
+    // Sets the priority of a pending read, lower or higher. A read shared by several requesters gets whatever was set last
+    void update_priority(const std::filesystem::path& path, FileRequestPriority priority);
+
+    auto get_num_workers() const -> std::size_t
+    {
+      return workers.size();
+    }
+
+    auto get_num_coalesced() const -> std::size_t
+    {
+      return num_coalesced;
+    }
+
+    auto get_in_flight_bytes() const -> std::size_t
+    {
+      return in_flight_bytes;
+    }
+
+    auto get_peak_in_flight_bytes() const -> std::size_t
+    {
+      return peak_in_flight_bytes;
+    }
+
+    auto get_in_flight_ceiling() const -> std::size_t
+    {
+      return in_flight_ceiling;
+    }
+
+    auto get_num_stalls() const -> std::size_t
+    {
+      return num_stalls;
+    }
+
+    auto get_cache() -> MPQFileCache&
+    {
+      return cache;
+    }
+
+    auto get_disk_cache() -> MPQDiskCache&
+    {
+      return disk_cache;
+    }
+
+    auto get_cooked_pack() const -> const CookedPack&
+    {
+      return cooked_pack;
+    }
+
+    // Null until the index is loaded or built, files are resolved through the patch chain meanwhile
+    auto get_index() const -> std::shared_ptr<const MPQIndex>;
+
+    // Enumerates the chain by a pattern like "Creature/Bear/*.skin", empty while the index isn't there yet
+    auto find_files(std::string_view pattern) const -> std::vector<std::string>;
 
   private:
     explicit MPQFileManager()
-      : running(true)
-      , thread(&MPQFileManager::run, this)
+      : running(false)
     {
     }
 
     void run();
+    void load_index(const std::filesystem::path& index_path, const std::string& chain_fingerprint);
     void stop();
-    void enqueue_request(RequestCallback&& callback);
+    void enqueue_request(StringId path, FileRequestPriority priority);
+    void enqueue_job(StringId path, FileRequestPriority priority, const FileRequestToken& token, Job&& job);
+    void raise_priority(StringId path, FileRequestPriority priority);
+    void set_pending_priority(StringId path, PendingFile& pending_file, FileRequestPriority priority);
+    void complete_request(StringId path, const FileBuffer& buffer);
+    void add_waiter(StringId path, Waiter&& waiter, FileRequestPriority priority);
+    void drop_pending_file(std::unordered_map<StringId, PendingFile>::iterator it);
+    static void notify_cancelled_waiters(std::vector<Waiter>&& waiters);
+    auto track_in_flight(const FileBuffer& buffer) -> FileBuffer;
+    void release_in_flight(std::size_t size);
+    auto is_stalled(FileRequestPriority priority) const -> bool;
 
-    RequestCallback pop_next_request();
+    static auto get_path_id(const std::filesystem::path& path) -> StringId;
+    auto open_file(WorkerContext& context, StringId path) const -> OpenedFile;
+    auto load_file(WorkerContext& context, StringId path) -> FileBuffer;
+    auto map_file(WorkerContext& context, StringId path) const -> FileBuffer;
+    auto is_mapped(const FileBuffer& buffer) const -> bool;
+    auto read_file(WorkerContext& context, StringId path) const -> FileBuffer;
+    static auto read_file(HANDLE handle, const std::string& path) -> FileBuffer;
+    static auto compare_requests(const Request& a, const Request& b) -> bool;
+    auto pop_next_request() -> std::optional<Request>;
 
   private:
-    MPQChain chain{};
     bool running;
-    std::thread thread;
+    std::vector<std::filesystem::path> archive_paths;
+    std::vector<std::thread> workers;
+    MPQRawBackend raw_backend{ MPQRawBackend::STREAM };
+    bool map_archives{ false };
+    std::vector<std::shared_ptr<MappedFile>> archive_mappings; // parallel to archive_paths, null if not mapped
+    std::filesystem::path cooked_pack_path;
+    CookedPack cooked_pack;
+    std::thread index_thread;
+    mutable std::mutex index_mutex;
+    std::shared_ptr<const MPQIndex> index;
     std::mutex requests_mutex;
     std::condition_variable cv;
-    std::queue<RequestCallback> requests;
+    std::uint64_t next_sequence{ 0 };
+    std::vector<Request> requests; // binary heap ordered by compare_requests
+    std::unordered_map<StringId, PendingFile> pending_files;
+    std::vector<Waiter> cancelled_waiters; // dropped with a pending file, still to be called back outside the lock
+    std::atomic_size_t num_coalesced{ 0 };
+    std::size_t in_flight_ceiling{ 0 };
+    std::atomic_size_t in_flight_bytes{ 0 }; // handed to consumers and not released yet
+    std::atomic_size_t peak_in_flight_bytes{ 0 };
+    std::atomic_size_t num_stalls{ 0 };
+    MPQFileCache cache;
+    MPQDiskCache disk_cache;
+    MPQPrefetchManifest prefetch_manifest;
+    std::filesystem::path prefetch_manifest_path;
   };
 
 } // namespace loki
@@ -0,0 +1,51 @@
+/*
+ * This file is part of the Loki Project.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "mpq_file_stream.h"
+
+#include <algorithm>
+
+loki::MPQFileStream::MPQFileStream(const MPQFile& file, unsigned long chunk_size)
+  : file(file)
+  , size(file.is_valid() ? file.get_size() : 0)
+  , chunk(chunk_size)
+{
+}
+
+auto
+loki::MPQFileStream::next() -> std::span<const char>
+{
+  if (is_eof()) {
+    return {};
+  }
+
+  auto bytes_read = file.read_range(position, chunk.data(), static_cast<unsigned long>(chunk.size()));
+  position += bytes_read;
+
+  // Nothing more can be read, so don't keep the caller spinning
+  if (bytes_read == 0) {
+    position = size;
+  }
+
+  return { chunk.data(), bytes_read };
+}
+
+void
+loki::MPQFileStream::skip(unsigned long bytes)
+{
+  position = std::min(position + bytes, size);
+}
@@ -0,0 +1,67 @@
+/*
+ * This file is part of the Loki Project.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <span>
+#include <vector>
+
+#include "mpq_file.h"
+
+namespace loki {
+
+  // Pulls a file chunk by chunk, so a parser never has to hold the whole decompressed file
+  class MPQFileStream
+  {
+  public:
+    static constexpr unsigned long DEFAULT_CHUNK_SIZE = 64 * 1024;
+
+    explicit MPQFileStream(const MPQFile& file, unsigned long chunk_size = DEFAULT_CHUNK_SIZE);
+
+  public:
+    auto is_valid() const -> bool
+    {
+      return file.is_valid();
+    }
+
+    auto is_eof() const -> bool
+    {
+      return position >= size;
+    }
+
+    auto get_position() const -> unsigned long
+    {
+      return position;
+    }
+
+    auto get_size() const -> unsigned long
+    {
+      return size;
+    }
+
+    // The returned span is valid until the next call, it's empty at the end of the file
+    auto next() -> std::span<const char>;
+    void skip(unsigned long bytes);
+
+  private:
+    const MPQFile& file;
+    unsigned long size;
+    unsigned long position{ 0 };
+    std::vector<char> chunk;
+  };
+
+} // namespace loki
@@ -0,0 +1,293 @@
+/*
+ * This file is part of the Loki Project.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "mpq_index.h"
+
+#include <algorithm>
+#include <fstream>
+
+#include "engine/utils/strings.h"
+#include "mpq_archive.h"
+#include "spdlog/spdlog.h"
+
+namespace {
+
+  constexpr std::uint32_t INDEX_MAGIC = 0x58494B4C; // LKIX
+  constexpr std::uint32_t INDEX_VERSION = 1;
+
+  template<typename T>
+  void write_value(std::ofstream& stream, const T& value)
+  {
+    stream.write(reinterpret_cast<const char*>(&value), sizeof(T));
+  }
+
+  void write_string(std::ofstream& stream, const std::string& string)
+  {
+    write_value(stream, static_cast<std::uint16_t>(string.size()));
+    stream.write(string.data(), static_cast<std::streamsize>(string.size()));
+  }
+
+  template<typename T>
+  auto read_value(std::ifstream& stream, T& value) -> bool
+  {
+    return static_cast<bool>(stream.read(reinterpret_cast<char*>(&value), sizeof(T)));
+  }
+
+  auto read_string(std::ifstream& stream, std::string& string) -> bool
+  {
+    std::uint16_t size = 0;
+    if (!read_value(stream, size)) {
+      return false;
+    }
+
+    string.resize(size);
+    return static_cast<bool>(stream.read(string.data(), size));
+  }
+
+  auto match_pattern(std::string_view path, std::string_view pattern) -> bool
+  {
+    // Greedy matching with a single backtrack point, enough for '*' and '?'
+    std::size_t p = 0;
+    std::size_t s = 0;
+    std::size_t star = std::string_view::npos;
+    std::size_t star_match = 0;
+
+    while (s < path.size()) {
+      if (p < pattern.size() && (pattern[p] == '?' || pattern[p] == path[s])) {
+        ++p;
+        ++s;
+      } else if (p < pattern.size() && pattern[p] == '*') {
+        star = p++;
+        star_match = s;
+      } else if (star != std::string_view::npos) {
+        p = star + 1;
+        s = ++star_match;
+      } else {
+        return false;
+      }
+    }
+
+    while (p < pattern.size() && pattern[p] == '*') {
+      ++p;
+    }
+
+    return p == pattern.size();
+  }
+
+} // namespace
+
+auto
+loki::MPQIndex::Entry::requires_chain() const -> bool
+{
+  return (flags & MPQ_FILE_PATCH_FILE) != 0;
+}
+
+auto
+loki::MPQIndex::build(const std::vector<std::filesystem::path>& archive_paths) -> MPQIndex
+{
+  MPQIndex index;
+
+  for (std::uint32_t i = 0; i < archive_paths.size(); ++i) {
+    const auto& archive_path = archive_paths[i];
+
+    // The chain is opened without listfiles, here we need them to enumerate the content
+    HANDLE archive{};
+    if (!SFileOpenArchive(archive_path.string().c_str(), 0, MPQ_OPEN_READ_ONLY, &archive)) {
+      spdlog::error("Error opening MPQ archive: {}", archive_path.string());
+      continue;
+    }
+
+    SFILE_FIND_DATA data{};
+    HANDLE find = SFileFindFirstFile(archive, "*", &data, nullptr);
+    if (find) {
+      do {
+        auto path = normalize_path(data.cFileName);
+
+        // Later archives in the chain override earlier ones, including deletions
+        if (data.dwFileFlags & MPQ_FILE_DELETE_MARKER) {
+          index.entries.erase(path);
+          continue;
+        }
+
+        Entry entry;
+        entry.archive = i;
+        entry.block = data.dwBlockIndex;
+        entry.size = data.dwFileSize;
+        entry.flags = data.dwFileFlags;
+
+        // Incremental patch needs the base file from the earlier archives, let the chain resolve it
+        if (entry.requires_chain()) {
+          if (auto it = index.entries.find(path); it != index.entries.end()) {
+            it->second.flags |= MPQ_FILE_PATCH_FILE;
+          }
+          continue;
+        }
+
+        index.entries.insert_or_assign(std::move(path), entry);
+      } while (SFileFindNextFile(find, &data));
+
+      SFileFindClose(find);
+    }
+
+    SFileCloseArchive(archive);
+  }
+
+  index.sort_paths();
+
+  spdlog::info("MPQ index is built: {} files in {} archives", index.entries.size(), archive_paths.size());
+  return index;
+}
+
+auto
+loki::MPQIndex::normalize_path(std::string_view path) -> std::string
+{
+  auto result = to_uppercase(path);
+  std::replace(result.begin(), result.end(), '/', '\\');
+  return result;
+}
+
+auto
+loki::MPQIndex::load(const std::filesystem::path& index_path, const std::string& chain_fingerprint) -> bool
+{
+  std::ifstream stream(index_path, std::ios::binary);
+  if (!stream) {
+    return false;
+  }
+
+  std::uint32_t magic = 0;
+  std::uint32_t version = 0;
+  std::string fingerprint;
+  if (!read_value(stream, magic) || !read_value(stream, version) || !read_string(stream, fingerprint)) {
+    return false;
+  }
+
+  // Any change of archive sizes or modification times produces another fingerprint
+  if (magic != INDEX_MAGIC || version != INDEX_VERSION || fingerprint != chain_fingerprint) {
+    spdlog::info("MPQ index '{}' is outdated", index_path.string());
+    return false;
+  }
+
+  std::uint32_t num_entries = 0;
+  if (!read_value(stream, num_entries)) {
+    return false;
+  }
+
+  std::unordered_map<std::string, Entry> loaded_entries;
+  loaded_entries.reserve(num_entries);
+
+  for (std::uint32_t i = 0; i < num_entries; ++i) {
+    std::string path;
+    Entry entry;
+    if (!read_string(stream, path) || !read_value(stream, entry.archive) || !read_value(stream, entry.block) || !read_value(stream, entry.size) ||
+        !read_value(stream, entry.flags)) {
+      spdlog::error("MPQ index '{}' is truncated", index_path.string());
+      return false;
+    }
+
+    loaded_entries.emplace(std::move(path), entry);
+  }
+
+  entries = std::move(loaded_entries);
+  sort_paths();
+  spdlog::info("MPQ index is loaded: {} files", entries.size());
+
+  return true;
+}
+
+auto
+loki::MPQIndex::save(const std::filesystem::path& index_path, const std::string& chain_fingerprint) const -> bool
+{
+  auto temp_path = index_path;
+  temp_path += ".tmp";
+
+  {
+    std::ofstream stream(temp_path, std::ios::binary | std::ios::trunc);
+
+    write_value(stream, INDEX_MAGIC);
+    write_value(stream, INDEX_VERSION);
+    write_string(stream, chain_fingerprint);
+    write_value(stream, static_cast<std::uint32_t>(entries.size()));
+
+    for (const auto& [path, entry] : entries) {
+      write_string(stream, path);
+      write_value(stream, entry.archive);
+      write_value(stream, entry.block);
+      write_value(stream, entry.size);
+      write_value(stream, entry.flags);
+    }
+
+    if (!stream) {
+      spdlog::error("Failed to write the MPQ index '{}'", index_path.string());
+      return false;
+    }
+  }
+
+  std::error_code error;
+  std::filesystem::rename(temp_path, index_path, error);
+
+  return !error;
+}
+
+auto
+loki::MPQIndex::find(const std::string& path) const -> const Entry*
+{
+  auto it = entries.find(path);
+  return it != entries.end() ? &it->second : nullptr;
+}
+
+auto
+loki::MPQIndex::find_prefix(std::string_view prefix) const -> std::vector<std::string_view>
+{
+  auto normalized_prefix = normalize_path(prefix);
+  auto begin = std::lower_bound(sorted_paths.begin(), sorted_paths.end(), std::string_view(normalized_prefix));
+  auto end = std::find_if_not(begin, sorted_paths.end(), [&normalized_prefix](std::string_view path) {
+    return path.starts_with(normalized_prefix);
+  });
+
+  return { begin, end };
+}
+
+auto
+loki::MPQIndex::find_files(std::string_view pattern) const -> std::vector<std::string_view>
+{
+  auto normalized_pattern = normalize_path(pattern);
+  auto literal_size = normalized_pattern.find_first_of("*?");
+  if (literal_size == std::string::npos) {
+    auto it = entries.find(normalized_pattern);
+    return it != entries.end() ? std::vector<std::string_view>{ it->first } : std::vector<std::string_view>{};
+  }
+
+  auto candidates = find_prefix(std::string_view(normalized_pattern).substr(0, literal_size));
+  std::erase_if(candidates, [&normalized_pattern](std::string_view path) {
+    return !match_pattern(path, normalized_pattern);
+  });
+
+  return candidates;
+}
+
+void
+loki::MPQIndex::sort_paths()
+{
+  sorted_paths.clear();
+  sorted_paths.reserve(entries.size());
+
+  for (const auto& [path, entry] : entries) {
+    sorted_paths.emplace_back(path);
+  }
+
+  std::sort(sorted_paths.begin(), sorted_paths.end());
+}
@@ -0,0 +1,89 @@
+/*
+ * This file is part of the Loki Project.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <filesystem>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace loki {
+
+  // Maps every file of the chain to the archive that wins it, so opening a file is one hash probe
+  // in a single archive instead of a walk over the whole patch chain
+  class MPQIndex
+  {
+  public:
+    struct Entry
+    {
+      std::uint32_t archive{ 0 }; // index in the archive list the index was built from
+      std::uint32_t block{ 0 };
+      std::uint32_t size{ 0 };
+      std::uint32_t flags{ 0 };
+
+      // Incremental patches have to be applied on top of the base file by StormLib
+      auto requires_chain() const -> bool;
+    };
+
+  public:
+    explicit MPQIndex() = default;
+
+    // The sorted paths point into the entries, which only stay in place when moved
+    MPQIndex(const MPQIndex&) = delete;
+    MPQIndex& operator=(const MPQIndex&) = delete;
+    MPQIndex(MPQIndex&&) = default;
+    MPQIndex& operator=(MPQIndex&&) = default;
+
+  public:
+    // Expensive, enumerates the listfile of every archive
+    static auto build(const std::vector<std::filesystem::path>& archive_paths) -> MPQIndex;
+    static auto normalize_path(std::string_view path) -> std::string;
+
+    auto load(const std::filesystem::path& index_path, const std::string& chain_fingerprint) -> bool;
+    auto save(const std::filesystem::path& index_path, const std::string& chain_fingerprint) const -> bool;
+
+    // Expects a normalized path
+    auto find(const std::string& path) const -> const Entry*;
+
+    // Paths starting with the prefix, in sorted order. The views are valid as long as the index is
+    auto find_prefix(std::string_view prefix) const -> std::vector<std::string_view>;
+
+    // Paths matching a pattern with '*' and '?', case-insensitive and with either slash, e.g. "Creature/Bear/*.skin".
+    // '*' crosses directories, so "World/Maps/Azeroth/*" lists the whole tree. Only the range of the literal prefix is scanned
+    auto find_files(std::string_view pattern) const -> std::vector<std::string_view>;
+
+    auto get_num_entries() const -> std::size_t
+    {
+      return entries.size();
+    }
+
+    auto get_entries() const -> const std::unordered_map<std::string, Entry>&
+    {
+      return entries;
+    }
+
+  private:
+    void sort_paths();
+
+  private:
+    std::unordered_map<std::string, Entry> entries;
+    std::vector<std::string_view> sorted_paths; // keys of entries
+  };
+
+} // namespace loki
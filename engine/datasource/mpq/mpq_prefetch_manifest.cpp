@@ -0,0 +1,97 @@
+/*
+ * This file is part of the Loki Project.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "mpq_prefetch_manifest.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+
+#include "spdlog/spdlog.h"
+
+auto
+loki::MPQPrefetchManifest::load(const std::filesystem::path& manifest_path) -> std::vector<Entry>
+{
+  std::vector<Entry> result;
+
+  std::ifstream stream(manifest_path);
+  if (!stream) {
+    return result;
+  }
+
+  // One "<milliseconds since start>\t<path>" line per file
+  std::string line;
+  while (std::getline(stream, line)) {
+    auto separator = line.find('\t');
+    if (separator == std::string::npos) {
+      continue;
+    }
+
+    Entry entry;
+    entry.time_ms = static_cast<std::uint32_t>(std::strtoul(line.c_str(), nullptr, 10));
+    entry.path = line.substr(separator + 1);
+    result.push_back(std::move(entry));
+  }
+
+  std::stable_sort(result.begin(), result.end(), [](const Entry& a, const Entry& b) {
+    return a.time_ms < b.time_ms;
+  });
+
+  return result;
+}
+
+void
+loki::MPQPrefetchManifest::start_recording()
+{
+  std::lock_guard lock(mutex);
+  recording = true;
+  start_time = std::chrono::steady_clock::now();
+  recorded_paths.clear();
+  entries.clear();
+}
+
+void
+loki::MPQPrefetchManifest::record(StringId path)
+{
+  std::lock_guard lock(mutex);
+
+  if (!recording || !recorded_paths.insert(path).second) {
+    return;
+  }
+
+  auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start_time);
+  entries.emplace_back(static_cast<std::uint32_t>(elapsed.count()), path);
+}
+
+auto
+loki::MPQPrefetchManifest::save(const std::filesystem::path& manifest_path) const -> bool
+{
+  std::lock_guard lock(mutex);
+
+  std::ofstream stream(manifest_path, std::ios::trunc);
+  for (const auto& [time_ms, path] : entries) {
+    stream << time_ms << '\t' << path.to_string() << '\n';
+  }
+
+  if (!stream) {
+    spdlog::error("Failed to write the prefetch manifest '{}'", manifest_path.string());
+    return false;
+  }
+
+  spdlog::info("Prefetch manifest '{}' is saved: {} files", manifest_path.string(), entries.size());
+  return true;
+}
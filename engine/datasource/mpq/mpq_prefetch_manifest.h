@@ -0,0 +1,63 @@
+/*
+ * This file is part of the Loki Project.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <chrono>
+#include <filesystem>
+#include <mutex>
+#include <unordered_set>
+#include <vector>
+
+#include "engine/utils/string_manager.h"
+
+namespace loki {
+
+  // The order files were first requested in during a session, replayed as prefetch on the next launch
+  class MPQPrefetchManifest
+  {
+  public:
+    struct Entry
+    {
+      std::uint32_t time_ms;
+      std::string path;
+    };
+
+  public:
+    explicit MPQPrefetchManifest() = default;
+
+  public:
+    static auto load(const std::filesystem::path& manifest_path) -> std::vector<Entry>;
+
+    void start_recording();
+    void record(StringId path);
+    auto save(const std::filesystem::path& manifest_path) const -> bool;
+
+    auto is_recording() const -> bool
+    {
+      return recording;
+    }
+
+  private:
+    mutable std::mutex mutex;
+    bool recording{ false };
+    std::chrono::steady_clock::time_point start_time{};
+    std::unordered_set<StringId> recorded_paths;
+    std::vector<std::pair<std::uint32_t, StringId>> entries;
+  };
+
+} // namespace loki
@@ -0,0 +1,363 @@
+/*
+ * This file is part of the Loki Project.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "mpq_raw_reader.h"
+
+#include <algorithm>
+#include <fstream>
+#include <unordered_map>
+#include <vector>
+
+#include "spdlog/spdlog.h"
+
+#ifdef LOKI_USE_IO_URING
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <thread>
+#include <unistd.h>
+#endif
+
+namespace {
+
+  class StreamRawReader : public loki::MPQRawReader
+  {
+  public:
+    auto get_backend() const -> loki::MPQRawBackend override
+    {
+      return loki::MPQRawBackend::STREAM;
+    }
+
+    auto read(const std::filesystem::path& archive_path, std::span<const Block> blocks, const BlockCallback& callback) -> bool override
+    {
+      std::ifstream stream(archive_path, std::ios::binary);
+      if (!stream) {
+        return false;
+      }
+
+      for (std::size_t i = 0; i < blocks.size(); ++i) {
+        const auto& block = blocks[i];
+        stream.seekg(static_cast<std::streamoff>(block.offset));
+        if (!stream.read(block.buffer.data(), static_cast<std::streamsize>(block.buffer.size()))) {
+          return false;
+        }
+
+        callback(i);
+      }
+
+      return true;
+    }
+  };
+
+#ifdef LOKI_USE_IO_URING
+
+  // Talks to the kernel directly, the few syscalls needed here don't justify a dependency on liburing
+  class IoUringRawReader : public loki::MPQRawReader
+  {
+    static constexpr unsigned QUEUE_DEPTH = 64;
+    static constexpr auto DRAIN_TIMEOUT = std::chrono::seconds(1);
+
+  public:
+    ~IoUringRawReader() override
+    {
+      for (auto& [path, fd] : files) {
+        close(fd);
+      }
+
+      if (sqes) {
+        munmap(sqes, sqes_size);
+      }
+
+      if (cq_ring && cq_ring != sq_ring) {
+        munmap(cq_ring, cq_ring_size);
+      }
+
+      if (sq_ring) {
+        munmap(sq_ring, sq_ring_size);
+      }
+
+      if (ring_fd >= 0) {
+        close(ring_fd);
+      }
+    }
+
+    auto init() -> bool
+    {
+      io_uring_params params{};
+      ring_fd = static_cast<int>(syscall(__NR_io_uring_setup, QUEUE_DEPTH, &params));
+      if (ring_fd < 0) {
+        spdlog::warn("io_uring is not available: {}", std::strerror(errno));
+        return false;
+      }
+
+      sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+      cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+
+      bool single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+      if (single_mmap) {
+        sq_ring_size = cq_ring_size = std::max(sq_ring_size, cq_ring_size);
+      }
+
+      sq_ring = map_ring(sq_ring_size, IORING_OFF_SQ_RING);
+      cq_ring = single_mmap ? sq_ring : map_ring(cq_ring_size, IORING_OFF_CQ_RING);
+      sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+      sqes = static_cast<io_uring_sqe*>(map_ring(sqes_size, IORING_OFF_SQES));
+      if (!sq_ring || !cq_ring || !sqes) {
+        spdlog::warn("Failed to map io_uring rings: {}", std::strerror(errno));
+        return false;
+      }
+
+      auto* sq = static_cast<char*>(sq_ring);
+      sq_tail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+      sq_mask = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+      sq_array = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+      sq_entries = params.sq_entries;
+
+      auto* cq = static_cast<char*>(cq_ring);
+      cq_head = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+      cq_tail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+      cq_mask = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+      cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+
+      return true;
+    }
+
+    auto get_backend() const -> loki::MPQRawBackend override
+    {
+      return broken ? loki::MPQRawBackend::STREAM : loki::MPQRawBackend::IO_URING;
+    }
+
+    auto read(const std::filesystem::path& archive_path, std::span<const Block> blocks, const BlockCallback& callback) -> bool override
+    {
+      // A ring that couldn't be waited on anymore isn't trusted with another read
+      if (broken) {
+        return fallback.read(archive_path, blocks, callback);
+      }
+
+      int fd = get_file(archive_path);
+      if (fd < 0) {
+        return false;
+      }
+
+      // Bytes still missing per block, short reads are resubmitted for the rest
+      std::vector<std::size_t> done(blocks.size(), 0);
+      std::size_t next_block = 0;
+      std::size_t completed = 0;
+      unsigned in_flight = 0;
+      bool failed = false;
+
+      while (completed < blocks.size() && !failed) {
+        unsigned submitted = 0;
+        while (next_block < blocks.size() && in_flight + submitted < sq_entries) {
+          push_read(fd, blocks[next_block], 0, next_block);
+          ++next_block;
+          ++submitted;
+        }
+
+        auto consumed = static_cast<unsigned>(std::max(enter(submitted, 1), 0));
+        in_flight += consumed;
+        if (consumed < submitted) {
+          discard_unsubmitted(submitted - consumed);
+          failed = true;
+        }
+
+        unsigned head = std::atomic_ref<unsigned>(*cq_head).load(std::memory_order_relaxed);
+        unsigned tail = std::atomic_ref<unsigned>(*cq_tail).load(std::memory_order_acquire);
+
+        for (; head != tail; ++head) {
+          const auto& cqe = cqes[head & cq_mask];
+          auto i = static_cast<std::size_t>(cqe.user_data);
+          --in_flight;
+
+          if (cqe.res <= 0) {
+            spdlog::error("io_uring read of '{}' failed: {}", archive_path.string(), cqe.res < 0 ? std::strerror(-cqe.res) : "unexpected end of file");
+            failed = true;
+            continue;
+          }
+
+          done[i] += static_cast<std::size_t>(cqe.res);
+          if (done[i] < blocks[i].buffer.size()) {
+            // Doesn't need a free slot check, the completion has just freed one
+            push_read(fd, blocks[i], done[i], i);
+            if (enter(1, 0) < 1) {
+              discard_unsubmitted(1);
+              failed = true;
+            } else {
+              ++in_flight;
+            }
+            continue;
+          }
+
+          ++completed;
+          callback(i);
+        }
+
+        std::atomic_ref<unsigned>(*cq_head).store(head, std::memory_order_release);
+      }
+
+      // Reads that are still in flight write into buffers owned by the caller, so wait them out before returning,
+      // and leave no completion behind for the next read
+      std::chrono::steady_clock::time_point deadline{};
+      while (in_flight > 0) {
+        if (!broken) {
+          int result = enter(0, 1);
+          if (result == -EAGAIN || result == -EBUSY) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+          } else if (result < 0) {
+            // The kernel can't be waited on anymore, whatever it still completes within the timeout is collected by polling.
+            // The rest of the reads fail and the stream backend takes over from now on
+            spdlog::error("io_uring can't be waited on anymore, falling back to the stream backend");
+            broken = true;
+            failed = true;
+            deadline = std::chrono::steady_clock::now() + DRAIN_TIMEOUT;
+          }
+        } else if (std::chrono::steady_clock::now() < deadline) {
+          std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        } else {
+          spdlog::error("Gave up on {} io_uring read(s) of '{}'", in_flight, archive_path.string());
+          break;
+        }
+
+        unsigned head = std::atomic_ref<unsigned>(*cq_head).load(std::memory_order_relaxed);
+        unsigned tail = std::atomic_ref<unsigned>(*cq_tail).load(std::memory_order_acquire);
+        in_flight -= tail - head;
+        std::atomic_ref<unsigned>(*cq_head).store(tail, std::memory_order_release);
+      }
+
+      return !failed;
+    }
+
+  private:
+    auto map_ring(std::size_t size, std::uint64_t offset) const -> void*
+    {
+      void* address = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, static_cast<off_t>(offset));
+      return address != MAP_FAILED ? address : nullptr;
+    }
+
+    auto get_file(const std::filesystem::path& path) -> int
+    {
+      auto it = files.find(path.string());
+      if (it != files.end()) {
+        return it->second;
+      }
+
+      int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+      if (fd < 0) {
+        spdlog::error("Cannot open '{}': {}", path.string(), std::strerror(errno));
+        return fd;
+      }
+
+      files.emplace(path.string(), fd);
+      return fd;
+    }
+
+    void push_read(int fd, const Block& block, std::size_t done, std::size_t user_data)
+    {
+      unsigned tail = std::atomic_ref<unsigned>(*sq_tail).load(std::memory_order_relaxed);
+      unsigned index = tail & sq_mask;
+
+      auto& sqe = sqes[index];
+      std::memset(&sqe, 0, sizeof(sqe));
+      sqe.opcode = IORING_OP_READ;
+      sqe.fd = fd;
+      sqe.addr = reinterpret_cast<std::uint64_t>(block.buffer.data() + done);
+      sqe.len = static_cast<std::uint32_t>(block.buffer.size() - done);
+      sqe.off = block.offset + done;
+      sqe.user_data = user_data;
+
+      sq_array[index] = index;
+      std::atomic_ref<unsigned>(*sq_tail).store(tail + 1, std::memory_order_release);
+    }
+
+    // Returns how many submissions the kernel took, or -errno if the call failed. The kernel reports a failure only when it took none
+    auto enter(unsigned to_submit, unsigned min_complete) -> int
+    {
+      unsigned flags = min_complete ? IORING_ENTER_GETEVENTS : 0;
+
+      long result;
+      while ((result = syscall(__NR_io_uring_enter, ring_fd, to_submit, min_complete, flags, nullptr, 0)) < 0) {
+        int error = errno;
+        if (error != EINTR) {
+          spdlog::error("io_uring_enter failed: {}", std::strerror(error));
+          return -error;
+        }
+      }
+
+      return static_cast<int>(result);
+    }
+
+    // Takes back entries the kernel didn't consume, so a later read never submits them with buffers that are gone by then
+    void discard_unsubmitted(unsigned count)
+    {
+      unsigned tail = std::atomic_ref<unsigned>(*sq_tail).load(std::memory_order_relaxed);
+      std::atomic_ref<unsigned>(*sq_tail).store(tail - count, std::memory_order_release);
+    }
+
+  private:
+    int ring_fd{ -1 };
+    void* sq_ring{ nullptr };
+    void* cq_ring{ nullptr };
+    std::size_t sq_ring_size{ 0 };
+    std::size_t cq_ring_size{ 0 };
+    std::size_t sqes_size{ 0 };
+    io_uring_sqe* sqes{ nullptr };
+    unsigned* sq_tail{ nullptr };
+    unsigned* sq_array{ nullptr };
+    unsigned sq_mask{ 0 };
+    unsigned sq_entries{ 0 };
+    unsigned* cq_head{ nullptr };
+    unsigned* cq_tail{ nullptr };
+    unsigned cq_mask{ 0 };
+    io_uring_cqe* cqes{ nullptr };
+    std::unordered_map<std::string, int> files;
+    StreamRawReader fallback;
+    bool broken{ false };
+  };
+
+#endif
+
+} // namespace
+
+auto
+loki::MPQRawReader::create(MPQRawBackend backend) -> std::unique_ptr<MPQRawReader>
+{
+#ifdef LOKI_USE_IO_URING
+  if (backend == MPQRawBackend::IO_URING) {
+    auto reader = std::make_unique<IoUringRawReader>();
+    if (reader->init()) {
+      return reader;
+    }
+  }
+#else
+  if (backend == MPQRawBackend::IO_URING) {
+    spdlog::warn("io_uring support is not compiled in, using the stream backend");
+  }
+#endif
+
+  return std::make_unique<StreamRawReader>();
+}
+
+auto
+loki::MPQRawReader::parse_backend(std::string_view name) -> MPQRawBackend
+{
+  return name == "io_uring" || name == "uring" ? MPQRawBackend::IO_URING : MPQRawBackend::STREAM;
+}
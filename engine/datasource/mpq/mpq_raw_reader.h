@@ -0,0 +1,60 @@
+/*
+ * This file is part of the Loki Project.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <span>
+#include <string_view>
+
+namespace loki {
+
+  enum class MPQRawBackend : std::uint8_t
+  {
+    STREAM,
+    IO_URING, // Linux only, falls back to STREAM if the kernel doesn't allow it or the ring stops responding
+  };
+
+  // Reads raw blocks of archive files, bypassing StormLib. Not thread-safe, every worker owns its reader
+  class MPQRawReader
+  {
+  public:
+    struct Block
+    {
+      std::uint64_t offset;
+      std::span<char> buffer;
+    };
+
+    // Called as soon as a block lands, blocks may complete in any order
+    using BlockCallback = std::function<void(std::size_t)>;
+
+  public:
+    virtual ~MPQRawReader() = default;
+
+    static auto create(MPQRawBackend backend) -> std::unique_ptr<MPQRawReader>;
+    static auto parse_backend(std::string_view name) -> MPQRawBackend;
+
+    virtual auto get_backend() const -> MPQRawBackend = 0;
+
+    // Returns false if any block couldn't be read completely
+    virtual auto read(const std::filesystem::path& archive_path, std::span<const Block> blocks, const BlockCallback& callback) -> bool = 0;
+  };
+
+} // namespace loki
@@ -0,0 +1,153 @@
+/*
+ * This file is part of the Loki Project.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "mpq_sector_reader.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+
+#include "spdlog/spdlog.h"
+
+namespace {
+
+  template<typename T>
+  auto get_info(HANDLE handle, SFileInfoClass info_class, T& value) -> bool
+  {
+    return SFileGetFileInfo(handle, info_class, &value, sizeof(T), nullptr);
+  }
+
+} // namespace
+
+auto
+loki::MPQSectorReader::read(const std::filesystem::path& archive_path, HANDLE archive, HANDLE file, MPQRawReader& raw_reader)
+  -> std::optional<std::vector<char>>
+{
+  DWORD flags = 0;
+  DWORD file_size = 0;
+  DWORD compressed_size = 0;
+  DWORD sector_size = 0;
+  ULONGLONG byte_offset = 0;
+  ULONGLONG header_offset = 0;
+
+  if (!get_info(file, SFileInfoFlags, flags) || !get_info(file, SFileInfoFileSize, file_size) || !get_info(file, SFileInfoCompressedSize, compressed_size) ||
+      !get_info(file, SFileInfoByteOffset, byte_offset) || !get_info(archive, SFileMpqSectorSize, sector_size) ||
+      !get_info(archive, SFileMpqHeaderOffset, header_offset)) {
+    return std::nullopt;
+  }
+
+  constexpr DWORD unsupported_flags = MPQ_FILE_ENCRYPTED | MPQ_FILE_PATCH_FILE | MPQ_FILE_SINGLE_UNIT | MPQ_FILE_DELETE_MARKER;
+  if (file_size < MIN_FILE_SIZE || sector_size == 0 || (flags & unsupported_flags) || !(flags & MPQ_FILE_COMPRESS_MASK)) {
+    return std::nullopt;
+  }
+
+  // Compressed data starts with the table of sector offsets, one more entry than sectors to mark the end of the last one
+  const std::size_t num_sectors = (file_size + sector_size - 1) / sector_size;
+  const std::size_t table_size = (num_sectors + 1) * sizeof(DWORD);
+  if (compressed_size < table_size) {
+    return std::nullopt;
+  }
+
+  const std::uint64_t file_offset = header_offset + byte_offset;
+  std::vector<char> raw(compressed_size);
+
+  MPQRawReader::Block table_block{ file_offset, std::span(raw.data(), table_size) };
+  if (!raw_reader.read(archive_path, std::span(&table_block, 1), [](std::size_t) {})) {
+    spdlog::error("Failed to read the sector table of a file from '{}'", archive_path.string());
+    return std::nullopt;
+  }
+
+  std::vector<DWORD> offsets(num_sectors + 1);
+  std::memcpy(offsets.data(), raw.data(), table_size);
+
+  if (offsets[0] < table_size) {
+    return std::nullopt;
+  }
+
+  for (std::size_t i = 0; i < num_sectors; ++i) {
+    if (offsets[i] > offsets[i + 1] || offsets[i + 1] > compressed_size) {
+      return std::nullopt;
+    }
+  }
+
+  // Group neighbour sectors into blocks, so there are few enough reads to keep in flight and enough to overlap with decompression
+  std::vector<MPQRawReader::Block> blocks;
+  std::vector<std::size_t> first_sectors;
+
+  for (std::size_t first = 0; first < num_sectors;) {
+    auto last = first + 1;
+    while (last < num_sectors && offsets[last + 1] - offsets[first] <= READ_BLOCK_SIZE) {
+      ++last;
+    }
+
+    auto begin = offsets[first];
+    blocks.push_back({ file_offset + begin, std::span(raw.data() + begin, offsets[last] - begin) });
+    first_sectors.push_back(first);
+    first = last;
+  }
+
+  first_sectors.push_back(num_sectors);
+
+  std::vector<char> data(file_size);
+  std::atomic_bool failed{ false };
+  JobCounter decompressed;
+
+  auto decompress = [&](std::size_t i) {
+    auto* out = data.data() + i * sector_size;
+    int out_size = static_cast<int>(std::min<std::size_t>(sector_size, file_size - i * sector_size));
+
+    auto* in = raw.data() + offsets[i];
+    int in_size = static_cast<int>(offsets[i + 1] - offsets[i]);
+
+    // A sector that didn't shrink is stored as is
+    if (in_size == out_size) {
+      std::memcpy(out, in, out_size);
+      return;
+    }
+
+    int expected_size = out_size;
+    int result = (flags & MPQ_FILE_IMPLODE) ? SCompExplode(out, &out_size, in, in_size) : SCompDecompress(out, &out_size, in, in_size);
+    if (!result || out_size != expected_size) {
+      failed = true;
+    }
+  };
+
+  bool read = raw_reader.read(archive_path, blocks, [&](std::size_t block) {
+    JobSystem::get_ref().submit(
+        [&, block]() {
+          for (auto i = first_sectors[block]; i < first_sectors[block + 1]; ++i) {
+            decompress(i);
+          }
+        },
+        &decompressed);
+  });
+
+  // The jobs in flight reference this frame, even if the read failed halfway
+  JobSystem::get_ref().wait(decompressed);
+
+  if (!read) {
+    spdlog::error("Failed to read raw sectors of a file from '{}'", archive_path.string());
+    return std::nullopt;
+  }
+
+  if (failed) {
+    spdlog::error("Failed to decompress sectors of a file from '{}'", archive_path.string());
+    return std::nullopt;
+  }
+
+  return data;
+}
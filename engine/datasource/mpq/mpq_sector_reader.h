@@ -0,0 +1,45 @@
+/*
+ * This file is part of the Loki Project.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <filesystem>
+#include <optional>
+#include <vector>
+
+#include "engine/mt/job_system.h"
+#include "mpq_archive.h"
+#include "mpq_raw_reader.h"
+
+namespace loki {
+
+  // Decompresses the sectors of one big file concurrently. Only plain compressed files stored in the given archive qualify:
+  // encrypted, single unit and patch files are left to SFileReadFile
+  class MPQSectorReader
+  {
+  public:
+    static constexpr unsigned long MIN_FILE_SIZE = 512 * 1024;
+    static constexpr std::size_t READ_BLOCK_SIZE = 256 * 1024; // sectors are read in blocks of about this size
+
+  public:
+    // The archive must be opened on its own, not as a part of a patch chain, otherwise the offsets point to the wrong file.
+    // Every block of sectors becomes a job as soon as the raw reader completes it
+    static auto read(const std::filesystem::path& archive_path, HANDLE archive, HANDLE file, MPQRawReader& raw_reader)
+      -> std::optional<std::vector<char>>;
+  };
+
+} // namespace loki
@@ -22,6 +22,7 @@
 
 #include <filesystem>
 #include <memory>
+#include <string>
 #include <utility>
 
 namespace loki {
@@ -29,6 +30,18 @@ namespace loki {
   struct EngineSettings
   {
     std::filesystem::path root_path;
+    std::size_t num_file_workers{ 0 }; // 0 means half the cores, from 2 to 4
+    std::size_t num_job_workers{ 0 };  // 0 means one per core but the main one
+    std::size_t file_cache_budget_mb{ 256 };
+    std::size_t file_cache_compressed_mb{ 128 }; // LZ4 tier for files evicted from the cache, 0 disables it
+    std::size_t file_in_flight_mb{ 256 }; // reads below HIGH priority stall above this many MB awaiting consumers, 0 = no limit
+    std::filesystem::path cache_dir; // persistent cache of decompressed files, disabled if empty
+    std::filesystem::path prefetch_manifest;
+    std::string io_backend{ "stream" }; // raw reads of big MPQ files, "stream" or "io_uring"
+    bool map_archives{ false };          // hand out uncompressed files as views into the mapped archives
+    std::filesystem::path cooked_pack;   // hot files cooked by LokiCookPack, tried before the archives
+    double main_thread_budget_ms{ 4.0 }; // time per frame for main thread tasks like texture uploads, 0 = no limit
+    std::size_t asset_budget_mb{ 1024 };  // CPU and GPU memory of loaded assets, split by type, 0 = never evict
   };
 
   class EngineApp
@@ -63,6 +76,11 @@ namespace loki {
       return settings->root_path;
     }
 
+    auto get_settings() const -> const EngineSettings&
+    {
+      return *settings;
+    }
+
     auto get_window() const -> GLFWwindow*
     {
       return window;
@@ -23,11 +23,35 @@
 #include "glm/gtc/type_ptr.hpp"
 #include "libassert/assert.hpp"
 
-void
-loki::M2Model::on_fully_loaded(const std::vector<char>& buffer)
+auto
+loki::M2Model::prepare(std::span<const char> buffer) -> bool
 {
+  if (buffer.size() < sizeof(Header)) {
+    return false;
+  }
+
   auto* header = reinterpret_cast<const Header*>(buffer.data());
 
+  if (!header->name.fits(buffer.size(), 1) || !header->vertices.fits(buffer.size(), sizeof(ModelVertex)) ||
+      !header->textures.fits(buffer.size(), sizeof(M2ModelTextureDef)) || !header->tex_lookup.fits(buffer.size(), sizeof(std::uint16_t))) {
+    spdlog::error("Model file '{}' is truncated", asset_path.to_string());
+    return false;
+  }
+
+  if (header->number_of_views > MaxViewCount) {
+    spdlog::error("Model file '{}' has {} views", asset_path.to_string(), header->number_of_views);
+    return false;
+  }
+
+  // Checked before anything is filled in, a broken file leaves nothing behind
+  auto* texture_def = reinterpret_cast<const M2ModelTextureDef*>(&buffer[header->textures.offset]);
+  for (std::uint32_t i = 0; i < header->textures.number; ++i) {
+    if (texture_def[i].type == TextureType::FILENAME && !texture_def[i].name.fits(buffer.size(), 1)) {
+      spdlog::error("Model file '{}' has a texture name out of bounds", asset_path.to_string());
+      return false;
+    }
+  }
+
   model_name.resize(header->name.length);
   memcpy(model_name.data(), &buffer[header->name.offset], model_name.size());
 
@@ -42,23 +66,21 @@ loki::M2Model::on_fully_loaded(const std::vector<char>& buffer)
   for (std::uint32_t i = 0; i < header->number_of_views; ++i) {
     auto path = std::filesystem::path(asset_path.to_string());
     path.replace_extension("");
-    auto model_view_path = fmt::format("{}{:02}.skin", path.string(), i);
-    auto model_view = M2ModelView::create(model_view_path);
-    model_view->request_load_full();
-    model_views.push_back(std::move(model_view));
+    model_view_paths.push_back(fmt::format("{}{:02}.skin", path.string(), i));
   }
 
   spdlog::info("Number of textures: {}", header->textures.number);
 
-  auto* texture_def = reinterpret_cast<const M2ModelTextureDef*>(&buffer[header->textures.offset]);
-  textures.resize(header->textures.number);
+  num_textures = header->textures.number;
 
   for (std::uint32_t i = 0; i < header->textures.number; ++i) {
     if (texture_def[i].type == TextureType::FILENAME) {
-      std::string texture_name = &buffer[texture_def[i].name.offset];
+      const auto& name = texture_def[i].name;
+
+      // The name is null terminated within its length
+      std::string texture_name(&buffer[name.offset], strnlen(&buffer[name.offset], name.length));
       spdlog::info("Texture index: {}, name: {}", i, texture_name);
-      textures[i] = BLPTexture::create(texture_name);
-      textures[i]->request_load_full();
+      texture_paths.emplace_back(i, std::move(texture_name));
     }
   }
 
@@ -67,9 +89,9 @@ loki::M2Model::on_fully_loaded(const std::vector<char>& buffer)
   memcpy(raw_tex_lookup.data(), tex_lookup, header->tex_lookup.number * sizeof(std::uint16_t));
 
   // Probably we can get rid of it, but for now let's live with these guys
-  std::vector<glm::vec3> vertices;
-  std::vector<glm::vec3> normals;
-  std::vector<glm::vec2> texcoords;
+  vertices.reserve(raw_vertices.size());
+  normals.reserve(raw_vertices.size());
+  texcoords.reserve(raw_vertices.size());
 
   for (auto& vertex : raw_vertices) {
     vertices.push_back(vertex.pos);
@@ -77,6 +99,30 @@ loki::M2Model::on_fully_loaded(const std::vector<char>& buffer)
     texcoords.push_back(vertex.texcoords);
   }
 
+  return true;
+}
+
+void
+loki::M2Model::upload()
+{
+  // Skins and textures load together as soon as the model itself is uploaded.
+  // After an eviction the dependencies are still alive, so the same instances come back
+  model_views.clear();
+  textures.clear();
+
+  for (const auto& model_view_path : model_view_paths) {
+    auto model_view = M2ModelView::create(model_view_path);
+    add_dependency(model_view);
+    model_views.push_back(std::move(model_view));
+  }
+
+  textures.resize(num_textures);
+
+  for (const auto& [index, texture_path] : texture_paths) {
+    textures[index] = BLPTexture::create(texture_path);
+    add_dependency(textures[index]);
+  }
+
   // That would be nice to delete all these buffers in the destructor, but
   // I don't want to call OpenGL-related things automatically in random places
   glGenVertexArrays(1, &vao);
@@ -111,16 +157,59 @@ loki::M2Model::on_fully_loaded(const std::vector<char>& buffer)
 
   // Clean the current buffer id
   glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+  gpu_size = vertices.size() * sizeof(glm::vec3) + normals.size() * sizeof(glm::vec3) + texcoords.size() * sizeof(glm::vec2);
+
+  model_view_paths = {};
+  texture_paths = {};
+  vertices = {};
+  normals = {};
+  texcoords = {};
 }
 
 void
-loki::M2Model::draw() const
+loki::M2Model::release()
+{
+  glDeleteBuffers(1, &vbuf);
+  glDeleteBuffers(1, &nbuf);
+  glDeleteBuffers(1, &tbuf);
+  glDeleteVertexArrays(1, &vao);
+
+  vao = vbuf = nbuf = tbuf = 0;
+  gpu_size = 0;
+
+  model_name = {};
+  raw_vertices = {};
+  raw_tex_lookup = {};
+  model_views.clear();
+  textures.clear();
+}
+
+auto
+loki::M2Model::get_memory_usage() const -> MemoryUsage
 {
   if (!is_loaded()) {
+    return {};
+  }
+
+  auto cpu = model_name.size() + raw_vertices.size() * sizeof(ModelVertex) + raw_tex_lookup.size() * sizeof(std::uint16_t);
+  return { cpu, gpu_size };
+}
+
+void
+loki::M2Model::draw()
+{
+  // Brings back whatever was evicted
+  touch();
+
+  if (!is_loaded() || model_views.empty()) {
     return;
   }
 
-  if (model_views.empty() || !model_views[0] || !model_views[0]->is_loaded()) {
+  // A resident tree has every skin and texture. Until then the model shows up as soon as the first skin is there,
+  // passes whose texture is still loading, was evicted or failed are skipped
+  const bool tree_resident = is_resident();
+  if (!tree_resident && !model_views[0]->is_loaded()) {
     return;
   }
 
@@ -155,8 +244,7 @@ loki::M2Model::draw() const
     auto& texture = textures[pass.tex];
     ASSERT(texture);
 
-    if (!texture->is_loaded()) {
-      // Skip drawing for unloaded textures
+    if (!tree_resident && !texture->is_loaded()) {
       continue;
     }
 
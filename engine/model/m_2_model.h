@@ -60,6 +60,7 @@ namespace loki {
   };
 
   constexpr int TextureMaxCount = 32;
+  constexpr std::uint32_t MaxViewCount = 4; // skin profiles, one per level of detail
 
   struct M2ModelTextureDef
   {
@@ -73,10 +74,14 @@ namespace loki {
   class M2Model : public AssetWrapper<M2Model>
   {
   public:
-    void draw() const;
+    void draw();
+
+    auto get_memory_usage() const -> MemoryUsage override;
 
   protected:
-    void on_fully_loaded(const std::vector<char>& buffer) override;
+    auto prepare(std::span<const char> buffer) -> bool override;
+    void upload() override;
+    void release() override;
 
   private:
 #pragma pack(push, 1)
@@ -118,10 +123,20 @@ namespace loki {
     std::vector<std::uint16_t> raw_tex_lookup;
     std::vector<std::shared_ptr<M2ModelView>> model_views;
     std::vector<std::shared_ptr<BLPTexture>> textures;
+
+    // Filled by prepare and released once upload is done with them
+    std::vector<std::string> model_view_paths;
+    std::vector<std::pair<std::uint32_t, std::string>> texture_paths;
+    std::uint32_t num_textures{ 0 };
+    std::vector<glm::vec3> vertices;
+    std::vector<glm::vec3> normals;
+    std::vector<glm::vec2> texcoords;
+
     GLuint vao;
     GLuint vbuf;
     GLuint nbuf;
     GLuint tbuf;
+    std::size_t gpu_size{ 0 };
   };
 
 } // namespace loki
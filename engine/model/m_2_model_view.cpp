@@ -16,16 +16,52 @@
  */
 
 #include "m_2_model_view.h"
+
+#include <algorithm>
+
 #include "libassert/assert.hpp"
 
-void
-loki::M2ModelView::on_fully_loaded(const std::vector<char>& buffer)
+auto
+loki::M2ModelView::prepare(std::span<const char> buffer) -> bool
 {
+  if (buffer.size() < sizeof(header)) {
+    return false;
+  }
+
   memcpy(&header, buffer.data(), sizeof(header));
-  ASSERT(header.id[0] == 'S' && header.id[1] == 'K' && header.id[2] == 'I' && header.id[3] == 'N');
+  if (header.id[0] != 'S' || header.id[1] != 'K' || header.id[2] != 'I' || header.id[3] != 'N') {
+    spdlog::error("'{}' is not a skin file", asset_path.to_string());
+    return false;
+  }
+
+  if (!header.index.fits(buffer.size(), sizeof(std::uint16_t)) || !header.tris.fits(buffer.size(), sizeof(std::uint16_t)) ||
+      !header.sub.fits(buffer.size(), sizeof(M2ModelGeoset)) || !header.tex.fits(buffer.size(), sizeof(M2ModelTexUnit))) {
+    spdlog::error("Skin file '{}' is truncated", asset_path.to_string());
+    return false;
+  }
 
   const auto* index_lookup = reinterpret_cast<const std::uint16_t*>(&buffer[header.index.offset]);
   const auto* triangles = reinterpret_cast<const std::uint16_t*>(&buffer[header.tris.offset]);
+  auto* ops = reinterpret_cast<const M2ModelGeoset*>(&buffer[header.sub.offset]);
+
+  // A rejected skin must not keep half of its data, so all of it is validated first
+  if (std::any_of(triangles, triangles + header.tris.number, [this](std::uint16_t index) {
+        return index >= header.index.number;
+      })) {
+    spdlog::error("Skin file '{}' has a triangle out of its index range", asset_path.to_string());
+    return false;
+  }
+
+  // Geosets are drawn straight from the indices, none of them may run past the end
+  std::uint64_t num_geoset_indices = 0;
+  for (std::uint32_t i = 0; i < header.sub.number; ++i) {
+    num_geoset_indices += ops[i].icount;
+  }
+
+  if (num_geoset_indices > header.tris.number) {
+    spdlog::error("Skin file '{}' has geosets beyond its indices", asset_path.to_string());
+    return false;
+  }
 
   raw_indices.resize(header.tris.number);
   for (std::uint32_t i = 0; i < header.tris.number; ++i) {
@@ -35,8 +71,6 @@ loki::M2ModelView::on_fully_loaded(const std::vector<char>& buffer)
   spdlog::info("Loaded indices: {}", raw_indices.size());
 
   // Render ops
-  auto* ops = reinterpret_cast<const M2ModelGeoset*>(&buffer[header.sub.offset]);
-
   std::uint32_t istart = 0;
   for (std::uint32_t i = 0; i < header.sub.number; ++i) {
     auto& hd_geo = raw_geosets.emplace_back(ops[i]);
@@ -52,4 +86,29 @@ loki::M2ModelView::on_fully_loaded(const std::vector<char>& buffer)
   memcpy(raw_tex_units.data(), tex_units, header.tex.number * sizeof(M2ModelTexUnit));
 
   spdlog::info("Loaded tex units: {}", raw_tex_units.size());
+  return true;
+}
+
+void
+loki::M2ModelView::upload()
+{
+  // Indices are still drawn from RAM, there is nothing to hand to GL
+}
+
+void
+loki::M2ModelView::release()
+{
+  raw_indices = {};
+  raw_geosets = {};
+  raw_tex_units = {};
+}
+
+auto
+loki::M2ModelView::get_memory_usage() const -> MemoryUsage
+{
+  if (!is_loaded()) {
+    return {};
+  }
+
+  return { raw_indices.size() * sizeof(std::uint16_t) + raw_geosets.size() * sizeof(M2ModelGeosetHD) + raw_tex_units.size() * sizeof(M2ModelTexUnit), 0 };
 }
@@ -33,6 +33,12 @@ namespace loki {
     };
 
     std::uint32_t offset;
+
+    // Whether the field's elements lie within a file of the given size
+    auto fits(std::size_t buffer_size, std::size_t element_size) const -> bool
+    {
+      return offset <= buffer_size && number <= (buffer_size - offset) / element_size;
+    }
   };
 
   struct M2ModelRenderPass
@@ -151,8 +157,13 @@ namespace loki {
   {
     friend class M2Model;
 
+  public:
+    auto get_memory_usage() const -> MemoryUsage override;
+
   protected:
-    void on_fully_loaded(const std::vector<char>& buffer) override;
+    auto prepare(std::span<const char> buffer) -> bool override;
+    void upload() override;
+    void release() override;
 
   private:
 #pragma pack(push, 1)
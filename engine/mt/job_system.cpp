@@ -0,0 +1,307 @@
+/*
+ * This file is part of the Loki Project.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "job_system.h"
+
+#include <algorithm>
+
+#include "spdlog/spdlog.h"
+
+namespace {
+
+  constexpr std::size_t NO_WORKER = static_cast<std::size_t>(-1);
+
+  thread_local std::size_t current_worker = NO_WORKER;
+
+} // namespace
+
+void
+loki::JobCounter::increment()
+{
+  count.fetch_add(1, std::memory_order_relaxed);
+}
+
+void
+loki::JobCounter::decrement()
+{
+  if (count.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+    wake();
+  }
+}
+
+void
+loki::JobCounter::wake()
+{
+  signal.fetch_add(1, std::memory_order_release);
+  signal.notify_all();
+}
+
+auto
+loki::JobSystem::get_default_num_workers() -> std::size_t
+{
+  auto num_cores = static_cast<std::size_t>(std::thread::hardware_concurrency());
+  return num_cores > 1 ? num_cores - 1 : 1;
+}
+
+void
+loki::JobSystem::init(std::size_t num_workers)
+{
+  main_thread_id = std::this_thread::get_id();
+
+  {
+    std::lock_guard lock(sleep_mutex);
+    running = true;
+  }
+
+  for (std::size_t i = 0; i < num_workers; ++i) {
+    queues.push_back(std::make_unique<WorkerQueue>());
+  }
+
+  for (std::size_t i = 0; i < num_workers; ++i) {
+    threads.emplace_back(&JobSystem::run, this, i);
+  }
+
+  spdlog::info("Job system started {} worker(s)", num_workers);
+}
+
+void
+loki::JobSystem::term()
+{
+  {
+    std::lock_guard lock(sleep_mutex);
+    running = false;
+  }
+
+  sleep_cv.notify_all();
+
+  for (auto& thread : threads) {
+    thread.join();
+  }
+
+  threads.clear();
+  queues.clear();
+}
+
+void
+loki::JobSystem::submit(Job&& job, JobCounter* counter)
+{
+  if (counter) {
+    counter->increment();
+  }
+
+  if (threads.empty()) {
+    job();
+    if (counter) {
+      counter->decrement();
+    }
+    return;
+  }
+
+  // Workers keep their own jobs, so what a job spawns stays hot in the cache of the core that spawned it
+  auto index = current_worker != NO_WORKER ? current_worker : next_queue.fetch_add(1, std::memory_order_relaxed) % queues.size();
+
+  {
+    std::lock_guard lock(queues[index]->mutex);
+    queues[index]->jobs.push_back({ std::move(job), counter });
+  }
+
+  num_queued.fetch_add(1, std::memory_order_release);
+
+  {
+    std::lock_guard lock(sleep_mutex);
+  }
+
+  sleep_cv.notify_one();
+}
+
+void
+loki::JobSystem::submit_main_thread(Job&& job, JobCounter* counter, MainThreadTaskPriority priority)
+{
+  if (counter) {
+    counter->increment();
+    job = [job = std::move(job), counter]() mutable {
+      job();
+      counter->decrement();
+    };
+  }
+
+  MainThreadQueue::get_ref().add_task(std::move(job), priority);
+
+  // A main thread waiting on the counter sleeps until there is something for it
+  if (counter) {
+    counter->wake();
+  }
+}
+
+void
+loki::JobSystem::wait(const JobCounter& counter)
+{
+  const bool main_thread = std::this_thread::get_id() == main_thread_id;
+
+  // Only workers pick up unrelated jobs. Any other thread could get stuck in a long one, say a file worker
+  // running an asset prepare while its reads wait, so it only helps with the jobs of this counter
+  const JobCounter* only_counter = current_worker != NO_WORKER ? nullptr : &counter;
+
+  while (!counter.is_done()) {
+    if (try_run_job(only_counter)) {
+      continue;
+    }
+
+    // Read before looking for more work, so a wake up in between isn't missed
+    auto signal = counter.signal.load(std::memory_order_acquire);
+
+    if (main_thread && MainThreadQueue::get_ref().perform_next_task()) {
+      continue;
+    }
+
+    // Nothing left to help with, the remaining jobs are running elsewhere
+    if (!counter.is_done()) {
+      counter.signal.wait(signal, std::memory_order_acquire);
+    }
+  }
+}
+
+void
+loki::JobSystem::parallel_for(std::size_t count, const std::function<void(std::size_t)>& function)
+{
+  std::atomic_size_t next{ 0 };
+  auto work = [&next, count, &function]() {
+    for (auto i = next++; i < count; i = next++) {
+      function(i);
+    }
+  };
+
+  // Every job takes indices until there are none left, there's no point in more jobs than workers
+  JobCounter counter;
+  auto num_jobs = std::min(count > 0 ? count - 1 : 0, get_num_workers());
+  for (std::size_t i = 0; i < num_jobs; ++i) {
+    submit(work, &counter);
+  }
+
+  work();
+  wait(counter);
+}
+
+void
+loki::JobSystem::run(std::size_t index)
+{
+  current_worker = index;
+
+  do {
+    if (try_run_job()) {
+      continue;
+    }
+
+    std::unique_lock lock(sleep_mutex);
+    sleep_cv.wait(lock, [this] {
+      return num_queued.load(std::memory_order_acquire) > 0 || !running;
+    });
+
+    // Jobs still queued at shutdown are run, a dropped job could be a coroutine that never finishes
+    if (!running && num_queued.load(std::memory_order_acquire) == 0) {
+      break;
+    }
+  } while (true);
+
+  current_worker = NO_WORKER;
+}
+
+auto
+loki::JobSystem::try_run_job(const JobCounter* only_counter) -> bool
+{
+  QueuedJob job;
+  if (only_counter ? !pop_counter_job(job, *only_counter) : !pop_job(job)) {
+    return false;
+  }
+
+  job.job();
+  if (job.counter) {
+    job.counter->decrement();
+  }
+
+  executed.fetch_add(1, std::memory_order_relaxed);
+
+  return true;
+}
+
+auto
+loki::JobSystem::pop_job(QueuedJob& job) -> bool
+{
+  if (queues.empty() || num_queued.load(std::memory_order_acquire) == 0) {
+    return false;
+  }
+
+  // Own queue from the back, the newest job is the likeliest to have its data in the cache
+  if (current_worker != NO_WORKER) {
+    auto& queue = *queues[current_worker];
+    std::lock_guard lock(queue.mutex);
+    if (!queue.jobs.empty()) {
+      job = std::move(queue.jobs.back());
+      queue.jobs.pop_back();
+      num_queued.fetch_sub(1, std::memory_order_relaxed);
+      return true;
+    }
+  }
+
+  // Others from the front, the oldest jobs are the ones their owner would get to last
+  auto start = current_worker != NO_WORKER ? current_worker + 1 : 0;
+  for (std::size_t i = 0; i < queues.size(); ++i) {
+    auto index = (start + i) % queues.size();
+    if (index == current_worker) {
+      continue;
+    }
+
+    auto& queue = *queues[index];
+    std::lock_guard lock(queue.mutex);
+    if (!queue.jobs.empty()) {
+      job = std::move(queue.jobs.front());
+      queue.jobs.pop_front();
+      num_queued.fetch_sub(1, std::memory_order_relaxed);
+
+      if (current_worker != NO_WORKER) {
+        stolen.fetch_add(1, std::memory_order_relaxed);
+      }
+      return true;
+    }
+  }
+
+  return false;
+}
+
+auto
+loki::JobSystem::pop_counter_job(QueuedJob& job, const JobCounter& counter) -> bool
+{
+  if (queues.empty() || num_queued.load(std::memory_order_acquire) == 0) {
+    return false;
+  }
+
+  for (auto& queue : queues) {
+    std::lock_guard lock(queue->mutex);
+    auto it = std::find_if(queue->jobs.begin(), queue->jobs.end(), [&counter](const QueuedJob& queued_job) {
+      return queued_job.counter == &counter;
+    });
+
+    if (it != queue->jobs.end()) {
+      job = std::move(*it);
+      queue->jobs.erase(it);
+      num_queued.fetch_sub(1, std::memory_order_relaxed);
+      return true;
+    }
+  }
+
+  return false;
+}
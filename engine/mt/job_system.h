@@ -0,0 +1,174 @@
+/*
+ * This file is part of the Loki Project.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "main_thread_queue.h"
+#include "unique_function.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <coroutine>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace loki {
+
+  using Job = UniqueFunction<void()>;
+
+  // Number of jobs submitted against it that haven't finished yet
+  class JobCounter
+  {
+    friend class JobSystem;
+
+  public:
+    JobCounter() = default;
+
+    JobCounter(const JobCounter&) = delete;
+    JobCounter& operator=(const JobCounter&) = delete;
+
+    auto is_done() const -> bool
+    {
+      return count.load(std::memory_order_acquire) == 0;
+    }
+
+  private:
+    void increment();
+    void decrement();
+    void wake();
+
+  private:
+    std::atomic_size_t count{ 0 };
+    std::atomic_uint32_t signal{ 0 }; // waiters sleep on it, bumped once the count is zero or a main thread job is submitted
+  };
+
+  // Engine wide workers, one per core but the main one. Each worker has its own deque: it takes its newest job first
+  // and steals the oldest ones of the others when it runs dry. Blocking I/O doesn't belong here, a worker waiting on
+  // a disk or a socket is a core nobody else can use, so the file workers and network sessions keep their threads
+  class JobSystem
+  {
+  public:
+    struct Stats
+    {
+      std::size_t executed{ 0 };
+      std::size_t stolen{ 0 };
+    };
+
+  public:
+    static JobSystem& get_ref()
+    {
+      static JobSystem instance;
+      return instance;
+    }
+
+    // The calling thread becomes the main thread, whose jobs go through the MainThreadQueue
+    void init(std::size_t num_workers);
+    void term();
+
+    // Runs the job on one of the workers, or right away if there are none. The counter goes up now and down once the job is done
+    void submit(Job&& job, JobCounter* counter = nullptr);
+
+    // For jobs that need the GL context or other main thread only state, they are performed within the main thread frame budget
+    void submit_main_thread(Job&& job, JobCounter* counter = nullptr, MainThreadTaskPriority priority = MainThreadTaskPriority::NORMAL);
+
+    // Runs other jobs until the counter is done, so waiting from inside a job doesn't take a worker away.
+    // Threads that aren't workers only run the jobs of this counter and sleep once there are none left.
+    // The main thread performs main thread tasks as well, nested in whatever it was doing when it started to wait,
+    // and those tasks may wait in turn. Jobs it waits for must reach it through submit_main_thread with the counter,
+    // otherwise it isn't woken up for them
+    void wait(const JobCounter& counter);
+
+    // Runs function(i) for every i in [0, count) and waits for all of them, the calling thread takes part
+    void parallel_for(std::size_t count, const std::function<void(std::size_t)>& function);
+
+    auto get_num_workers() const -> std::size_t
+    {
+      return threads.size();
+    }
+
+    auto get_stats() const -> Stats
+    {
+      return { executed.load(std::memory_order_relaxed), stolen.load(std::memory_order_relaxed) };
+    }
+
+    static auto get_default_num_workers() -> std::size_t;
+
+  private:
+    JobSystem() = default;
+
+    struct QueuedJob
+    {
+      Job job;
+      JobCounter* counter{ nullptr };
+    };
+
+    struct WorkerQueue
+    {
+      std::mutex mutex;
+      std::deque<QueuedJob> jobs;
+    };
+
+  private:
+    void run(std::size_t index);
+    auto try_run_job(const JobCounter* only_counter = nullptr) -> bool;
+    auto pop_job(QueuedJob& job) -> bool;
+    auto pop_counter_job(QueuedJob& job, const JobCounter& counter) -> bool;
+
+  private:
+    std::vector<std::unique_ptr<WorkerQueue>> queues;
+    std::vector<std::thread> threads;
+    std::thread::id main_thread_id{};
+    std::atomic_size_t next_queue{ 0 }; // threads that aren't workers hand their jobs out round robin
+    std::atomic_size_t num_queued{ 0 };
+    std::atomic_size_t executed{ 0 };
+    std::atomic_size_t stolen{ 0 };
+    std::mutex sleep_mutex;
+    std::condition_variable sleep_cv;
+    bool running{ false };
+  };
+
+  // co_await switch_to_job_system() continues the coroutine as a job
+  inline auto
+  switch_to_job_system()
+  {
+    struct Awaiter
+    {
+      auto await_ready() const noexcept -> bool
+      {
+        return false;
+      }
+
+      void await_suspend(std::coroutine_handle<> handle) const
+      {
+        JobSystem::get_ref().submit([handle]() {
+          handle.resume();
+        });
+      }
+
+      void await_resume() const noexcept
+      {
+      }
+    };
+
+    return Awaiter{};
+  }
+
+} // namespace loki
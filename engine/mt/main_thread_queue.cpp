@@ -18,40 +18,87 @@
 #include "main_thread_queue.h"
 
 void
-loki::MainThreadQueue::add_task(loki::MainThreadQueue::Task&& task)
+loki::MainThreadQueue::add_task(loki::MainThreadQueue::Task&& task, MainThreadTaskPriority priority)
 {
-  std::lock_guard lock(mutex);
-  task_queue.emplace(std::forward<Task>(task));
+  task_queues[static_cast<std::size_t>(priority)].push(std::move(task));
 }
 
 void
 loki::MainThreadQueue::perform_all_tasks()
 {
-  while (!is_empty()) {
-    auto task = get_next_task();
-    if (task) {
-      task();
+  perform_tasks(std::chrono::microseconds::zero());
+}
+
+void
+loki::MainThreadQueue::perform_tasks(std::chrono::microseconds budget)
+{
+  using Clock = std::chrono::steady_clock;
+
+  const auto start = Clock::now();
+  const auto performed_by_waits = num_performed_by_waits;
+  FrameStats stats;
+
+  while (auto task = get_next_task()) {
+    task();
+    ++stats.num_performed;
+
+    if (budget.count() && Clock::now() - start >= budget) {
+      break;
     }
   }
+
+  // Tasks that waits performed from inside the ones above are part of this frame as well
+  stats.num_performed += num_performed_by_waits - performed_by_waits;
+  stats.elapsed = std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - start);
+  stats.num_left = get_num_tasks();
+
+  if (budget.count() && stats.elapsed > budget) {
+    stats.overrun = stats.elapsed - budget;
+    ++num_overrun_frames;
+  }
+
+  frame_stats = stats;
 }
 
 auto
 loki::MainThreadQueue::get_next_task() -> Task
 {
-  std::lock_guard lock(mutex);
-  if (task_queue.empty()) {
-    return {};
+  for (auto it = task_queues.rbegin(); it != task_queues.rend(); ++it) {
+    if (auto task = it->pop()) {
+      return std::move(*task);
+    }
+  }
+
+  return {};
+}
+
+auto
+loki::MainThreadQueue::perform_next_task() -> bool
+{
+  auto task = get_next_task();
+  if (!task) {
+    return false;
   }
 
-  auto task = std::move(task_queue.front());
-  task_queue.pop();
+  task();
+  ++num_performed_by_waits;
 
-  return task;
+  return true;
 }
 
 auto
-loki::MainThreadQueue::is_empty() -> bool
+loki::MainThreadQueue::is_empty() const -> bool
 {
-  std::lock_guard lock(mutex);
-  return task_queue.empty();
+  return get_num_tasks() == 0;
+}
+
+auto
+loki::MainThreadQueue::get_num_tasks() const -> std::size_t
+{
+  std::size_t num_tasks = 0;
+  for (const auto& task_queue : task_queues) {
+    num_tasks += task_queue.get_size();
+  }
+
+  return num_tasks;
 }
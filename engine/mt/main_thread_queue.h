@@ -17,15 +17,35 @@
 
 #pragma once
 
-#include <functional>
-#include <mutex>
-#include <queue>
+#include "mpsc_queue.h"
+#include "unique_function.h"
+
+#include <array>
+#include <chrono>
+#include <coroutine>
+#include <cstdint>
 
 namespace loki {
 
+  enum class MainThreadTaskPriority : std::uint8_t
+  {
+    LOW,
+    NORMAL,
+    HIGH,
+  };
+
   class MainThreadQueue
   {
-    using Task = std::function<void()>;
+  public:
+    using Task = UniqueFunction<void()>;
+
+    struct FrameStats
+    {
+      std::size_t num_performed{ 0 };
+      std::size_t num_left{ 0 }; // carried over to the next frame
+      std::chrono::microseconds elapsed{ 0 };
+      std::chrono::microseconds overrun{ 0 }; // time spent past the budget, a single task can't be interrupted
+    };
 
   public:
     static MainThreadQueue& get_ref()
@@ -34,19 +54,72 @@ namespace loki {
       return instance;
     }
 
-    void add_task(Task&& task);
+    void add_task(Task&& task, MainThreadTaskPriority priority = MainThreadTaskPriority::NORMAL);
     void perform_all_tasks();
 
-    auto is_empty() -> bool;
+    // Performs tasks in priority order until the budget is spent, the rest waits for the next frame.
+    // At least one task is performed, so the queue keeps moving however small the budget is. Zero means no budget
+    void perform_tasks(std::chrono::microseconds budget);
+
+    // Main thread only, like the rest of the consuming side
+    auto is_empty() const -> bool;
     auto get_next_task() -> Task;
 
+    // Performs a single task for a wait on the main thread, it counts towards the perform_tasks call the wait is nested in
+    auto perform_next_task() -> bool;
+
+    // Stats of the last perform_tasks call
+    auto get_frame_stats() const -> const FrameStats&
+    {
+      return frame_stats;
+    }
+
+    auto get_num_overrun_frames() const -> std::size_t
+    {
+      return num_overrun_frames;
+    }
+
   private:
     MainThreadQueue() = default;
 
+    auto get_num_tasks() const -> std::size_t;
+
   private:
-    std::mutex mutex{};
-    std::queue<Task> task_queue{};
+    std::array<MPSCQueue<Task>, 3> task_queues{}; // one per priority, the highest is drained first
+    FrameStats frame_stats{};
+    std::size_t num_overrun_frames{ 0 };
+    std::size_t num_performed_by_waits{ 0 };
   };
 
+  // co_await switch_to_main_thread() continues the coroutine from the main thread's next perform_tasks
+  inline auto
+  switch_to_main_thread(MainThreadTaskPriority priority = MainThreadTaskPriority::NORMAL)
+  {
+    struct Awaiter
+    {
+      MainThreadTaskPriority priority;
+
+      auto await_ready() const noexcept -> bool
+      {
+        return false;
+      }
+
+      void await_suspend(std::coroutine_handle<> handle) const
+      {
+        MainThreadQueue::get_ref().add_task(
+            [handle]() {
+              handle.resume();
+            },
+            priority);
+      }
+
+      void await_resume() const noexcept
+      {
+      }
+    };
+
+    return Awaiter{ priority };
+  }
+
 } // namespace loki
 
@@ -0,0 +1,166 @@
+/*
+ * This file is part of the Loki Project.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <new>
+#include <optional>
+#include <utility>
+
+namespace loki {
+
+  // Lock-free queue with any number of producers and a single consumer. Producers push onto a Treiber stack,
+  // the consumer takes everything pushed so far with one exchange and keeps it as a private FIFO list.
+  // Nodes are recycled: the consumer returns them to a free list shared by all queues of the same T, producers grab
+  // that whole list at once into a thread-local cache, so pushing doesn't allocate once the queues are warm.
+  // Taking the whole free list with an exchange instead of popping nodes one by one is what keeps it free of ABA
+  template<typename T>
+  class MPSCQueue
+  {
+  public:
+    MPSCQueue() = default;
+
+    MPSCQueue(const MPSCQueue&) = delete;
+    MPSCQueue& operator=(const MPSCQueue&) = delete;
+
+    ~MPSCQueue()
+    {
+      while (pop()) {
+      }
+    }
+
+  public:
+    // Any thread
+    void push(T&& value)
+    {
+      auto* node = acquire_node();
+      new (node->storage) T(std::move(value));
+
+      // Counted before it's visible, so the consumer never takes the count below zero
+      num_items.fetch_add(1, std::memory_order_relaxed);
+
+      node->next = head.load(std::memory_order_relaxed);
+      while (!head.compare_exchange_weak(node->next, node, std::memory_order_release, std::memory_order_relaxed)) {
+      }
+    }
+
+    // Consumer thread only
+    auto pop() -> std::optional<T>
+    {
+      if (!consumer_list) {
+        take_pushed();
+        if (!consumer_list) {
+          return std::nullopt;
+        }
+      }
+
+      auto* node = std::exchange(consumer_list, consumer_list->next);
+      auto* item = std::launder(reinterpret_cast<T*>(node->storage));
+
+      std::optional<T> result(std::move(*item));
+      item->~T();
+      release_node(node);
+
+      num_items.fetch_sub(1, std::memory_order_relaxed);
+      return result;
+    }
+
+    // Exact for the consumer, a hint for everyone else
+    auto get_size() const -> std::size_t
+    {
+      return num_items.load(std::memory_order_relaxed);
+    }
+
+  private:
+    struct Node
+    {
+      alignas(T) std::byte storage[sizeof(T)];
+      Node* next{ nullptr };
+    };
+
+    struct FreeList
+    {
+      std::atomic<Node*> head{ nullptr };
+
+      ~FreeList()
+      {
+        delete_list(head.exchange(nullptr));
+      }
+    };
+
+    struct NodeCache
+    {
+      Node* head{ nullptr };
+
+      ~NodeCache()
+      {
+        delete_list(head);
+      }
+    };
+
+  private:
+    static void delete_list(Node* node)
+    {
+      while (node) {
+        delete std::exchange(node, node->next);
+      }
+    }
+
+    static auto acquire_node() -> Node*
+    {
+      auto& cache = node_cache;
+      if (!cache.head) {
+        cache.head = free_list.head.exchange(nullptr, std::memory_order_acquire);
+        if (!cache.head) {
+          return new Node;
+        }
+      }
+
+      return std::exchange(cache.head, cache.head->next);
+    }
+
+    static void release_node(Node* node)
+    {
+      node->next = free_list.head.load(std::memory_order_relaxed);
+      while (!free_list.head.compare_exchange_weak(node->next, node, std::memory_order_release, std::memory_order_relaxed)) {
+      }
+    }
+
+    void take_pushed()
+    {
+      // The stack is newest first, reversing it gives the push order back
+      auto* node = head.exchange(nullptr, std::memory_order_acquire);
+      while (node) {
+        auto* next = node->next;
+        node->next = consumer_list;
+        consumer_list = node;
+        node = next;
+      }
+    }
+
+  private:
+    std::atomic<Node*> head{ nullptr };
+    Node* consumer_list{ nullptr };
+    std::atomic_size_t num_items{ 0 };
+
+    static inline FreeList free_list{};
+    static inline thread_local NodeCache node_cache{};
+  };
+
+} // namespace loki
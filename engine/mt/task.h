@@ -0,0 +1,198 @@
+/*
+ * This file is part of the Loki Project.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <coroutine>
+#include <exception>
+#include <optional>
+#include <utility>
+
+namespace loki {
+
+  template<typename T>
+  class Task;
+
+  namespace detail {
+
+    struct TaskPromiseBase
+    {
+      struct FinalAwaiter
+      {
+        auto await_ready() const noexcept -> bool
+        {
+          return false;
+        }
+
+        // Symmetric transfer to whoever awaits the task, so long chains of tasks don't grow the stack
+        template<typename Promise>
+        auto await_suspend(std::coroutine_handle<Promise> handle) noexcept -> std::coroutine_handle<>
+        {
+          auto& promise = handle.promise();
+          if (promise.detached) {
+            handle.destroy();
+            return std::noop_coroutine();
+          }
+
+          return promise.continuation ? promise.continuation : std::noop_coroutine();
+        }
+
+        void await_resume() const noexcept
+        {
+        }
+      };
+
+      auto initial_suspend() const noexcept -> std::suspend_always
+      {
+        return {};
+      }
+
+      auto final_suspend() const noexcept -> FinalAwaiter
+      {
+        return {};
+      }
+
+      void unhandled_exception() const noexcept
+      {
+        std::terminate();
+      }
+
+      std::coroutine_handle<> continuation{};
+      bool detached{ false };
+    };
+
+    template<typename T>
+    struct TaskPromise : TaskPromiseBase
+    {
+      auto get_return_object() -> Task<T>;
+
+      void return_value(T result)
+      {
+        value.emplace(std::move(result));
+      }
+
+      std::optional<T> value{};
+    };
+
+    template<>
+    struct TaskPromise<void> : TaskPromiseBase
+    {
+      auto get_return_object() -> Task<void>;
+
+      void return_void() const noexcept
+      {
+      }
+    };
+
+  } // namespace detail
+
+  // A coroutine that starts when it's awaited, or when it's started on its own and then frees itself once it's done.
+  // Where it continues after a co_await depends on the awaitable: file reads resume on a file worker,
+  // switch_to_main_thread() on the main thread
+  template<typename T = void>
+  class [[nodiscard]] Task
+  {
+  public:
+    using promise_type = detail::TaskPromise<T>;
+
+  public:
+    explicit Task(std::coroutine_handle<promise_type> handle)
+      : handle(handle)
+    {
+    }
+
+    Task(Task&& other) noexcept
+      : handle(std::exchange(other.handle, {}))
+    {
+    }
+
+    Task& operator=(Task&& other) noexcept
+    {
+      if (this != &other) {
+        if (handle) {
+          handle.destroy();
+        }
+        handle = std::exchange(other.handle, {});
+      }
+      return *this;
+    }
+
+    Task(const Task&) = delete;
+    Task& operator=(const Task&) = delete;
+
+    ~Task()
+    {
+      if (handle) {
+        handle.destroy();
+      }
+    }
+
+  public:
+    // Fire and forget, nobody waits for the result
+    void start() &&
+    {
+      auto detached_handle = std::exchange(handle, {});
+      detached_handle.promise().detached = true;
+      detached_handle.resume();
+    }
+
+    auto operator co_await() && noexcept
+    {
+      struct Awaiter
+      {
+        std::coroutine_handle<promise_type> handle;
+
+        auto await_ready() const noexcept -> bool
+        {
+          return false;
+        }
+
+        auto await_suspend(std::coroutine_handle<> continuation) noexcept -> std::coroutine_handle<>
+        {
+          handle.promise().continuation = continuation;
+          return handle;
+        }
+
+        auto await_resume() -> T
+        {
+          if constexpr (!std::is_void_v<T>) {
+            return std::move(*handle.promise().value);
+          }
+        }
+      };
+
+      return Awaiter{ handle };
+    }
+
+  private:
+    std::coroutine_handle<promise_type> handle;
+  };
+
+  template<typename T>
+  auto
+  detail::TaskPromise<T>::get_return_object() -> Task<T>
+  {
+    return Task<T>(std::coroutine_handle<TaskPromise>::from_promise(*this));
+  }
+
+  inline auto
+  detail::TaskPromise<void>::get_return_object() -> Task<void>
+  {
+    return Task<void>(std::coroutine_handle<TaskPromise>::from_promise(*this));
+  }
+
+} // namespace loki
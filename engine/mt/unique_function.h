@@ -0,0 +1,151 @@
+/*
+ * This file is part of the Loki Project.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace loki {
+
+  template<typename Signature, std::size_t InlineSize = 48>
+  class UniqueFunction;
+
+  // Move-only std::function. Callables up to InlineSize bytes are stored in place, so a task capturing a couple of
+  // shared pointers or a coroutine handle never touches the heap
+  template<typename R, typename... Args, std::size_t InlineSize>
+  class UniqueFunction<R(Args...), InlineSize>
+  {
+  public:
+    UniqueFunction() = default;
+
+    UniqueFunction(std::nullptr_t)
+    {
+    }
+
+    template<typename F, typename = std::enable_if_t<!std::is_same_v<std::decay_t<F>, UniqueFunction> && std::is_invocable_r_v<R, std::decay_t<F>&, Args...>>>
+    UniqueFunction(F&& function)
+    {
+      using Callable = std::decay_t<F>;
+
+      if constexpr (is_inline<Callable>()) {
+        new (storage) Callable(std::forward<F>(function));
+        vtable = &inline_vtable<Callable>;
+      } else {
+        new (storage) Callable*(new Callable(std::forward<F>(function)));
+        vtable = &heap_vtable<Callable>;
+      }
+    }
+
+    UniqueFunction(UniqueFunction&& other) noexcept
+    {
+      move_from(other);
+    }
+
+    UniqueFunction& operator=(UniqueFunction&& other) noexcept
+    {
+      if (this != &other) {
+        reset();
+        move_from(other);
+      }
+      return *this;
+    }
+
+    UniqueFunction(const UniqueFunction&) = delete;
+    UniqueFunction& operator=(const UniqueFunction&) = delete;
+
+    ~UniqueFunction()
+    {
+      reset();
+    }
+
+  public:
+    auto operator()(Args... args) -> R
+    {
+      return vtable->invoke(storage, std::forward<Args>(args)...);
+    }
+
+    explicit operator bool() const
+    {
+      return vtable != nullptr;
+    }
+
+    void reset()
+    {
+      if (vtable) {
+        vtable->destroy(storage);
+        vtable = nullptr;
+      }
+    }
+
+  private:
+    struct VTable
+    {
+      R (*invoke)(void* storage, Args&&... args);
+      void (*move)(void* destination, void* source); // leaves the source destroyed
+      void (*destroy)(void* storage);
+    };
+
+    template<typename Callable>
+    static constexpr auto is_inline() -> bool
+    {
+      return sizeof(Callable) <= InlineSize && alignof(Callable) <= alignof(std::max_align_t) && std::is_nothrow_move_constructible_v<Callable>;
+    }
+
+    template<typename Callable>
+    static constexpr VTable inline_vtable{
+      [](void* storage, Args&&... args) -> R {
+        return (*static_cast<Callable*>(storage))(std::forward<Args>(args)...);
+      },
+      [](void* destination, void* source) {
+        new (destination) Callable(std::move(*static_cast<Callable*>(source)));
+        static_cast<Callable*>(source)->~Callable();
+      },
+      [](void* storage) {
+        static_cast<Callable*>(storage)->~Callable();
+      },
+    };
+
+    template<typename Callable>
+    static constexpr VTable heap_vtable{
+      [](void* storage, Args&&... args) -> R {
+        return (**static_cast<Callable**>(storage))(std::forward<Args>(args)...);
+      },
+      [](void* destination, void* source) {
+        new (destination) Callable*(*static_cast<Callable**>(source));
+      },
+      [](void* storage) {
+        delete *static_cast<Callable**>(storage);
+      },
+    };
+
+    void move_from(UniqueFunction& other)
+    {
+      if (other.vtable) {
+        other.vtable->move(storage, other.storage);
+        vtable = std::exchange(other.vtable, nullptr);
+      }
+    }
+
+  private:
+    alignas(std::max_align_t) std::byte storage[InlineSize];
+    const VTable* vtable{ nullptr };
+  };
+
+} // namespace loki
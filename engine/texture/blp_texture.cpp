@@ -19,34 +19,62 @@
 
 #include <GL/gl3w.h>
 
-#include "../blpconverter-src/blp.h"
 #include "libassert/assert.hpp"
 
-void
-loki::BLPTexture::on_fully_loaded(const std::vector<char>& buffer)
+auto
+loki::BLPTexture::prepare(std::span<const char> buffer) -> bool
 {
   tBLPInfos blp_info = blp_process_buffer(buffer.data());
-  ASSERT(blp_info);
+  if (!blp_info) {
+    return false;
+  }
+
+  pixels.reset(blp_convert_buffer(buffer.data(), blp_info));
+
+  width = static_cast<GLsizei>(blp_width(blp_info));
+  height = static_cast<GLsizei>(blp_height(blp_info));
+
+  blp_release(blp_info);
 
-  tBGRAPixel* raw_image_data = blp_convert_buffer(buffer.data(), blp_info);
-  ASSERT(raw_image_data);
+  return pixels != nullptr;
+}
 
-  const auto width = static_cast<GLsizei>(blp_width(blp_info));
-  const auto height = static_cast<GLsizei>(blp_height(blp_info));
+void
+loki::BLPTexture::upload()
+{
+  ASSERT(pixels);
 
   // Create new texture and put it in memory
   glGenTextures(1, &id);
   GLuint tex_format = GL_TEXTURE_2D;
   glBindTexture(tex_format, id);
 
-  glTexImage2D(tex_format, 0, GL_RGBA8, width, height, 0, GL_BGRA, GL_UNSIGNED_BYTE, raw_image_data);
+  glTexImage2D(tex_format, 0, GL_RGBA8, width, height, 0, GL_BGRA, GL_UNSIGNED_BYTE, pixels.get());
   glGenerateMipmap(tex_format);
 
   glTexParameteri(tex_format, GL_TEXTURE_MIN_FILTER, GL_LINEAR); // Linear Filtering
   glTexParameteri(tex_format, GL_TEXTURE_MAG_FILTER, GL_LINEAR); // Linear Filtering
 
-  delete[] raw_image_data;
-  blp_release(blp_info);
-
   glBindTexture(tex_format, 0);
+
+  pixels.reset();
+}
+
+void
+loki::BLPTexture::release()
+{
+  glDeleteTextures(1, &id);
+  id = 0;
+}
+
+auto
+loki::BLPTexture::get_memory_usage() const -> MemoryUsage
+{
+  if (!is_loaded()) {
+    return {};
+  }
+
+  // RGBA8 plus the mipmap chain, which adds about a third
+  auto base_size = static_cast<std::size_t>(width) * static_cast<std::size_t>(height) * 4;
+  return { 0, base_size + base_size / 3 };
 }
@@ -19,19 +19,32 @@
 
 #include <GL/gl3w.h>
 
+#include "../blpconverter-src/blp.h"
 #include "engine/asset/asset.h"
 
+#include <memory>
+
 namespace loki {
 
   class BLPTexture : public AssetWrapper<BLPTexture>
   {
     friend class M2Model;
 
+  public:
+    auto get_memory_usage() const -> MemoryUsage override;
+
   protected:
-    void on_fully_loaded(const std::vector<char>& buffer) override;
+    auto prepare(std::span<const char> buffer) -> bool override;
+    void upload() override;
+    void release() override;
 
   private:
     GLuint id = 0;
+
+    // Decoded by prepare, dropped as soon as GL has its copy
+    std::unique_ptr<tBGRAPixel[]> pixels;
+    GLsizei width = 0;
+    GLsizei height = 0;
   };
 
 } // namespace loki
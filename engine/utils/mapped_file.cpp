@@ -0,0 +1,102 @@
+/*
+ * This file is part of the Loki Project.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "mapped_file.h"
+
+#include "spdlog/spdlog.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef _WIN32
+
+loki::MappedFile::MappedFile(const std::filesystem::path& path)
+{
+  file = CreateFileW(path.wstring().c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+  if (file == INVALID_HANDLE_VALUE) {
+    file = nullptr;
+    return;
+  }
+
+  LARGE_INTEGER file_size{};
+  if (!GetFileSizeEx(file, &file_size) || file_size.QuadPart == 0) {
+    return;
+  }
+
+  mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+  if (!mapping) {
+    spdlog::error("Failed to map: {}", path.string());
+    return;
+  }
+
+  view = static_cast<const char*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+  length = view ? static_cast<std::size_t>(file_size.QuadPart) : 0;
+}
+
+loki::MappedFile::~MappedFile()
+{
+  if (view) {
+    UnmapViewOfFile(view);
+  }
+
+  if (mapping) {
+    CloseHandle(mapping);
+  }
+
+  if (file) {
+    CloseHandle(file);
+  }
+}
+
+#else
+
+loki::MappedFile::MappedFile(const std::filesystem::path& path)
+{
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return;
+  }
+
+  struct stat file_stat{};
+  if (fstat(fd, &file_stat) == 0 && file_stat.st_size > 0) {
+    void* address = mmap(nullptr, static_cast<std::size_t>(file_stat.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+    if (address != MAP_FAILED) {
+      view = static_cast<const char*>(address);
+      length = static_cast<std::size_t>(file_stat.st_size);
+    } else {
+      spdlog::error("Failed to map: {}", path.string());
+    }
+  }
+
+  // The mapping stays valid after the descriptor is closed
+  close(fd);
+}
+
+loki::MappedFile::~MappedFile()
+{
+  if (view) {
+    munmap(const_cast<char*>(view), length);
+  }
+}
+
+#endif
@@ -0,0 +1,66 @@
+/*
+ * This file is part of the Loki Project.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <filesystem>
+#include <span>
+
+namespace loki {
+
+  // Read-only mapping of a whole file, the OS page cache does the rest
+  class MappedFile
+  {
+  public:
+    explicit MappedFile(const std::filesystem::path& path);
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+  public:
+    auto is_valid() const -> bool
+    {
+      return view != nullptr;
+    }
+
+    auto data() const -> const char*
+    {
+      return view;
+    }
+
+    auto size() const -> std::size_t
+    {
+      return length;
+    }
+
+    auto get_span() const -> std::span<const char>
+    {
+      return { view, length };
+    }
+
+  private:
+    const char* view{ nullptr };
+    std::size_t length{ 0 };
+#ifdef _WIN32
+    void* file{ nullptr };
+    void* mapping{ nullptr };
+#endif
+  };
+
+} // namespace loki
@@ -18,6 +18,8 @@
 #pragma once
 
 #include <algorithm>
+#include <cstdint>
+#include <span>
 #include <string>
 
 namespace loki {
@@ -28,4 +30,15 @@ namespace loki {
     return result;
   };
 
+  static auto to_hex = [](std::span<const std::uint8_t> bytes) {
+    constexpr const char digits[] = "0123456789abcdef";
+    std::string result;
+    result.reserve(bytes.size() * 2);
+    for (auto byte : bytes) {
+      result += digits[byte >> 4];
+      result += digits[byte & 0xF];
+    }
+    return result;
+  };
+
 } // namespace loki
@@ -17,7 +17,9 @@
 
 #include "game_app.h"
 
+#include "engine/asset/asset_registry.h"
 #include "engine/model/m_2_model.h"
+#include "engine/mt/job_system.h"
 #include "engine/mt/main_thread_queue.h"
 #include "glm/glm.hpp"
 #include "glm/gtc/matrix_transform.hpp"
@@ -65,7 +67,9 @@ static std::string default_shader_frag =
 
 GameApp::~GameApp()
 {
+  // File workers hand their jobs to the job system, so they have to stop first
   loki::MPQFileManager::get_ref().term();
+  loki::JobSystem::get_ref().term();
 }
 
 // std::filesystem::path model_path = R"(Character\Draenei\Female\DraeneiFemale.M2)";
@@ -85,9 +89,37 @@ GameApp::on_init()
   vert = loki::ShaderManager::create_shader(default_shader_vert, loki::ShaderType::VERT);
   prog = loki::ShaderManager::create_program(vert, frag);
 
-  loki::MPQFileManager::get_ref().init(get_root_path() / "data");
+  const auto& settings = get_settings();
+  loki::JobSystem::get_ref().init(settings.num_job_workers ? settings.num_job_workers : loki::JobSystem::get_default_num_workers());
+
+  auto num_file_workers = settings.num_file_workers ? settings.num_file_workers : loki::MPQFileManager::get_default_num_workers();
+  loki::MPQFileManager::get_ref().get_cache().set_budget(settings.file_cache_budget_mb * 1024 * 1024);
+  loki::MPQFileManager::get_ref().get_cache().set_compressed_budget(settings.file_cache_compressed_mb * 1024 * 1024);
+  loki::MPQFileManager::get_ref().set_raw_backend(loki::MPQRawReader::parse_backend(settings.io_backend));
+  loki::MPQFileManager::get_ref().set_in_flight_ceiling(settings.file_in_flight_mb * 1024 * 1024);
+  loki::MPQFileManager::get_ref().set_map_archives(settings.map_archives);
+  loki::MPQFileManager::get_ref().set_cooked_pack(settings.cooked_pack);
+  loki::MPQFileManager::get_ref().init(get_root_path() / "data", num_file_workers, settings.cache_dir);
+
+  if (!settings.prefetch_manifest.empty()) {
+    loki::MPQFileManager::get_ref().enable_prefetch_manifest(settings.prefetch_manifest);
+  }
+
+  // Textures take most of it, the geometry is comparatively small
+  auto asset_budget = settings.asset_budget_mb * 1024 * 1024;
+  auto& asset_registry = loki::AssetRegistry::get_ref();
+  asset_registry.set_budget<loki::BLPTexture>("Textures", asset_budget / 4 * 3);
+  asset_registry.set_budget<loki::M2Model>("Models", asset_budget / 8);
+  asset_registry.set_budget<loki::M2ModelView>("Skins", asset_budget / 8);
+
   m2_model = loki::M2Model::create(model_path);
-  m2_model->request_load_full();
+  m2_model->request_load_full(loki::FileRequestPriority::HIGH);
+  m2_model->when_resident([](bool resident) {
+    // A model whose own file failed is reported by the asset, it still draws when only some skins or textures are missing
+    if (!resident && m2_model->is_loaded()) {
+      spdlog::error("Model '{}' is missing some of its skins or textures", model_path.string());
+    }
+  });
 
   glEnable(GL_DEPTH_TEST);
   glEnable(GL_CULL_FACE);
@@ -104,8 +136,12 @@ GameApp::on_term()
 void
 GameApp::on_update()
 {
-  // Update main thread at the start of the frame
-  loki::MainThreadQueue::get_ref().perform_all_tasks();
+  // Update main thread at the start of the frame, what doesn't fit the budget is left for the next one
+  auto budget = std::chrono::duration<double, std::milli>(get_settings().main_thread_budget_ms);
+  loki::MainThreadQueue::get_ref().perform_tasks(std::chrono::duration_cast<std::chrono::microseconds>(budget));
+
+  loki::AssetRegistry::get_ref().begin_frame();
+  loki::AssetRegistry::get_ref().evict_to_budgets();
 
   float x = camera.distance_to_origin * glm::sin(camera.phi) * glm::cos(camera.theta);
   float y = camera.distance_to_origin * glm::sin(camera.phi) * glm::sin(camera.theta);
@@ -196,6 +232,111 @@ GameApp::on_gui()
   }
 
   ImGui::End();
+
+  if (ImGui::Begin("Files")) {
+    auto& file_manager = loki::MPQFileManager::get_ref();
+    auto cache_stats = file_manager.get_cache().get_stats();
+
+    ImGui::Text("Workers: %zu", file_manager.get_num_workers());
+    ImGui::Text("Coalesced requests: %zu", file_manager.get_num_coalesced());
+
+    if (file_manager.get_in_flight_ceiling()) {
+      ImGui::Text("In flight: %.1f / %.1f MB (peak %.1f MB, %zu stalls)", (double)file_manager.get_in_flight_bytes() / (1024.0 * 1024.0),
+          (double)file_manager.get_in_flight_ceiling() / (1024.0 * 1024.0), (double)file_manager.get_peak_in_flight_bytes() / (1024.0 * 1024.0),
+          file_manager.get_num_stalls());
+    } else {
+      ImGui::Text("In flight: %.1f MB (peak %.1f MB)", (double)file_manager.get_in_flight_bytes() / (1024.0 * 1024.0),
+          (double)file_manager.get_peak_in_flight_bytes() / (1024.0 * 1024.0));
+    }
+
+    if (auto index = file_manager.get_index()) {
+      ImGui::Text("Index: %zu files", index->get_num_entries());
+    } else {
+      ImGui::Text("Index: building...");
+    }
+
+    if (file_manager.get_cooked_pack().is_open()) {
+      ImGui::Text("Cooked pack: %zu files", file_manager.get_cooked_pack().get_num_files());
+    }
+
+    ImGui::SeparatorText("Cache");
+    ImGui::Text("Size: %.1f / %.1f MB (%zu files)", (double)cache_stats.size / (1024.0 * 1024.0), (double)cache_stats.budget / (1024.0 * 1024.0), cache_stats.num_entries);
+    ImGui::Text("Hits: %zu, misses: %zu, evictions: %zu", cache_stats.hits, cache_stats.misses, cache_stats.evictions);
+
+    if (cache_stats.compressed_budget) {
+      ImGui::SeparatorText("Compressed cache");
+      ImGui::Text("Size: %.1f / %.1f MB (%zu files, %.1f MB decompressed)", (double)cache_stats.compressed_size / (1024.0 * 1024.0),
+          (double)cache_stats.compressed_budget / (1024.0 * 1024.0), cache_stats.compressed_num_entries, (double)cache_stats.compressed_raw_size / (1024.0 * 1024.0));
+      ImGui::Text("Hits: %zu, evictions: %zu", cache_stats.compressed_hits, cache_stats.compressed_evictions);
+    }
+
+    if (file_manager.get_disk_cache().is_enabled()) {
+      auto disk_stats = file_manager.get_disk_cache().get_stats();
+      ImGui::SeparatorText("Disk cache");
+      ImGui::Text("Hits: %zu, misses: %zu, writes: %zu", disk_stats.hits, disk_stats.misses, disk_stats.writes);
+    }
+  }
+
+  ImGui::End();
+
+  if (ImGui::Begin("Assets")) {
+    auto registry_stats = loki::AssetRegistry::get_ref().get_stats();
+    auto requested = registry_stats.reused + registry_stats.created;
+
+    ImGui::Text("Live: %zu", registry_stats.num_live);
+    ImGui::Text("Created: %zu, reused: %zu (%.1f%%)", registry_stats.created, registry_stats.reused,
+        requested ? 100.0 * (double)registry_stats.reused / (double)requested : 0.0);
+
+    if (ImGui::BeginTable("Memory", 5, ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg)) {
+      ImGui::TableSetupColumn("Type");
+      ImGui::TableSetupColumn("Loaded");
+      ImGui::TableSetupColumn("CPU / GPU (MB)");
+      ImGui::TableSetupColumn("Budget (MB)");
+      ImGui::TableSetupColumn("Evictions");
+      ImGui::TableHeadersRow();
+
+      for (const auto& memory_stats : loki::AssetRegistry::get_ref().get_memory_stats()) {
+        ImGui::TableNextRow();
+        ImGui::TableSetColumnIndex(0);
+        ImGui::Text("%s", memory_stats.type_name.c_str());
+        ImGui::TableSetColumnIndex(1);
+        ImGui::Text("%zu", memory_stats.num_loaded);
+        ImGui::TableSetColumnIndex(2);
+        ImGui::Text("%.1f / %.1f", (double)memory_stats.cpu / (1024.0 * 1024.0), (double)memory_stats.gpu / (1024.0 * 1024.0));
+        ImGui::TableSetColumnIndex(3);
+        ImGui::Text("%.1f", (double)memory_stats.budget / (1024.0 * 1024.0));
+        ImGui::TableSetColumnIndex(4);
+        ImGui::Text("%zu", memory_stats.evictions);
+      }
+
+      ImGui::EndTable();
+    }
+
+    if (m2_model && m2_model->is_tree_done()) {
+      const auto& timings = m2_model->get_load_timings();
+      ImGui::Text("Model %s in %.1f ms (own file %.1f ms, %zu dependencies)", m2_model->is_resident() ? "resident" : "failed",
+          (double)timings.tree.count() / 1000.0, (double)timings.self.count() / 1000.0, m2_model->get_dependencies().size());
+    } else {
+      ImGui::Text("Model loading...");
+    }
+
+    auto& main_thread_queue = loki::MainThreadQueue::get_ref();
+    const auto& frame_stats = main_thread_queue.get_frame_stats();
+
+    ImGui::SeparatorText("Main thread tasks");
+    ImGui::Text("Last frame: %zu performed, %zu left, %.2f ms", frame_stats.num_performed, frame_stats.num_left,
+        (double)frame_stats.elapsed.count() / 1000.0);
+    ImGui::Text("Overrun: %.2f ms (%zu frames over budget)", (double)frame_stats.overrun.count() / 1000.0, main_thread_queue.get_num_overrun_frames());
+
+    auto& job_system = loki::JobSystem::get_ref();
+    auto job_stats = job_system.get_stats();
+
+    ImGui::SeparatorText("Jobs");
+    ImGui::Text("Workers: %zu", job_system.get_num_workers());
+    ImGui::Text("Executed: %zu, stolen: %zu", job_stats.executed, job_stats.stolen);
+  }
+
+  ImGui::End();
 }
 
 void
@@ -11,6 +11,18 @@ main(int argc, char* argv[])
   std::shared_ptr<loki::EngineSettings> settings = std::make_shared<loki::EngineSettings>();
 
   app.add_option("--root", settings->root_path);
+  app.add_option("--job-workers", settings->num_job_workers, "Number of job system worker threads (0 = auto)");
+  app.add_option("--file-workers", settings->num_file_workers, "Number of MPQ file worker threads (0 = half the cores, from 2 to 4)");
+  app.add_option("--file-cache-mb", settings->file_cache_budget_mb, "Memory budget of the decompressed file cache in MB");
+  app.add_option("--file-cache-compressed-mb", settings->file_cache_compressed_mb, "Memory budget of the LZ4 tier for evicted files in MB (0 = disabled)");
+  app.add_option("--file-in-flight-mb", settings->file_in_flight_mb, "Reads below high priority stall above this many MB awaiting the main thread (0 = no limit)");
+  app.add_option("--cache-dir", settings->cache_dir, "Directory of the persistent file cache, disabled if not set");
+  app.add_option("--prefetch-manifest", settings->prefetch_manifest, "File to replay as prefetch on start and to record the accessed files to");
+  app.add_option("--io-backend", settings->io_backend, "Backend for raw reads of big MPQ files: stream or io_uring (Linux only)");
+  app.add_flag("--map-archives", settings->map_archives, "Map the archives and read uncompressed files without copying them");
+  app.add_option("--cooked-pack", settings->cooked_pack, "Pack of hot files cooked by LokiCookPack, read before the archives");
+  app.add_option("--asset-budget-mb", settings->asset_budget_mb, "Memory of loaded models and textures in MB, the least recently drawn are evicted above it (0 = no limit)");
+  app.add_option("--main-thread-budget-ms", settings->main_thread_budget_ms, "Time per frame for main thread tasks like asset uploads in ms (0 = no limit)");
   CLI11_PARSE(app, argc, argv)
 
   spdlog::info("Root: {}", absolute(settings->root_path).string());
@@ -0,0 +1,118 @@
+/*
+ * This file is part of the Loki Project.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <fstream>
+
+#include "CLI/CLI.hpp"
+#include "engine/datasource/cooked_pack.h"
+#include "engine/datasource/mpq/mpq_chain.h"
+#include "engine/datasource/mpq/mpq_index.h"
+#include "engine/datasource/mpq/mpq_prefetch_manifest.h"
+#include "spdlog/spdlog.h"
+
+// Cooks the files touched at login into a flat pack. The list comes from a prefetch manifest recorded by the game
+// and/or a plain text file with one path per line
+int
+main(int argc, char* argv[])
+{
+  CLI::App app{ "Loki cooked pack builder" };
+  argv = app.ensure_utf8(argv);
+
+  std::filesystem::path data_dir;
+  std::filesystem::path manifest_path;
+  std::filesystem::path list_path;
+  std::filesystem::path output_path;
+  bool compress = false;
+
+  app.add_option("--data", data_dir, "Directory with the MPQ archives")->required();
+  app.add_option("--manifest", manifest_path, "Prefetch manifest recorded with --prefetch-manifest");
+  app.add_option("--list", list_path, "Text file with one path per line");
+  app.add_option("--output", output_path, "Pack to write")->required();
+  app.add_flag("--lz4", compress, "Compress the files that shrink with LZ4");
+  CLI11_PARSE(app, argc, argv)
+
+  std::vector<std::string> paths;
+
+  if (!manifest_path.empty()) {
+    for (auto& entry : loki::MPQPrefetchManifest::load(manifest_path)) {
+      paths.push_back(std::move(entry.path));
+    }
+  }
+
+  if (!list_path.empty()) {
+    std::ifstream stream(list_path);
+    for (std::string line; std::getline(stream, line);) {
+      if (!line.empty() && line.back() == '\r') {
+        line.pop_back();
+      }
+
+      if (!line.empty()) {
+        paths.push_back(line);
+      }
+    }
+  }
+
+  if (paths.empty()) {
+    spdlog::error("Nothing to cook, pass --manifest or --list");
+    return 1;
+  }
+
+  // Files are read through the whole chain, so the pack holds them with every patch applied
+  auto archive_paths = loki::MPQChain::find_archives(data_dir);
+  loki::MPQChain chain(archive_paths);
+  HANDLE archive = chain.get_archive().get_handle();
+  if (!archive) {
+    spdlog::error("Cannot open the archives of '{}'", data_dir.string());
+    return 1;
+  }
+
+  std::vector<loki::CookedPack::File> files;
+  std::size_t total_size = 0;
+
+  for (const auto& path : paths) {
+    auto normalized_path = loki::MPQIndex::normalize_path(path);
+
+    HANDLE handle{};
+    if (!SFileOpenFileEx(archive, normalized_path.c_str(), SFILE_OPEN_FROM_MPQ, &handle)) {
+      spdlog::warn("Skipping '{}', not found", path);
+      continue;
+    }
+
+    loki::MPQFile file(normalized_path, handle);
+    std::vector<char> data;
+    auto read = file.read_all(data);
+    SFileCloseFile(handle);
+
+    if (read != data.size()) {
+      spdlog::warn("Skipping '{}', failed to read", path);
+      continue;
+    }
+
+    total_size += data.size();
+    files.push_back({ std::move(normalized_path), std::move(data) });
+  }
+
+  auto num_files = files.size();
+  if (!loki::CookedPack::write(output_path, loki::MPQChain::get_fingerprint(archive_paths), std::move(files), compress)) {
+    return 1;
+  }
+
+  spdlog::info("Cooked {} files, {:.1f} MB into '{}' ({:.1f} MB)", num_files, static_cast<double>(total_size) / (1024.0 * 1024.0), output_path.string(),
+      static_cast<double>(std::filesystem::file_size(output_path)) / (1024.0 * 1024.0));
+
+  return 0;
+}